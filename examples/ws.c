@@ -1,13 +1,19 @@
+// CPU pinning in wen_runtime needs the GNU affinity calls.
+#ifndef _GNU_SOURCE
+#    define _GNU_SOURCE
+#endif
 #define WEN_ENABLE_WS
 #define WEN_IMPLEMENTATION
 #include "wen.h"
 
 #include <arpa/inet.h>
+#include <errno.h>
 #include <netinet/in.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #define MAX_WS_PAYLOAD 125
@@ -163,35 +169,50 @@ static wen_result ws_decode(void *codec_state, const void *data, unsigned long l
     return WEN_OK;
 }
 
-static wen_result ws_encode(void *codec_state, unsigned opcode,
-                            const void *data, unsigned long len,
-                            void *out, unsigned long out_cap,
-                            unsigned long *out_len) {
+static wen_result ws_encode_header(void *codec_state, unsigned opcode,
+                                   unsigned long len,
+                                   void *out, unsigned long out_cap,
+                                   unsigned long *out_len) {
     (void)codec_state;
 
     uint8_t *b = out;
     unsigned hdr = 2;
 
+    if ((opcode & 0x08) && len > 125)
+        return WEN_ERR_PROTOCOL;
+
     if (len <= 125) {
-        if (out_cap < hdr + len) return WEN_ERR_OVERFLOW;
+        if (out_cap < hdr) return WEN_ERR_OVERFLOW;
         b[1] = len;
     } else if (len <= 0xFFFF) {
         hdr += 2;
-        if (out_cap < hdr + len) return WEN_ERR_OVERFLOW;
+        if (out_cap < hdr) return WEN_ERR_OVERFLOW;
         b[1] = 126;
         *(uint16_t *)(b + 2) = htons(len);
     } else {
         hdr += 8;
-        if (out_cap < hdr + len) return WEN_ERR_OVERFLOW;
+        if (out_cap < hdr) return WEN_ERR_OVERFLOW;
         b[1] = 127;
         uint64_t be = htobe64(len);
         memcpy(b + 2, &be, 8);
     }
-    if ((opcode & 0x08) && len > 125)
-        return WEN_ERR_PROTOCOL;
 
     b[0] = 0x80 | (opcode & 0x0F); // FIN + opcode
-    memcpy(b + hdr, data, len);
+
+    *out_len = hdr;
+    return WEN_OK;
+}
+
+static wen_result ws_encode(void *codec_state, unsigned opcode,
+                            const void *data, unsigned long len,
+                            void *out, unsigned long out_cap,
+                            unsigned long *out_len) {
+    unsigned long hdr = 0;
+    wen_result r = ws_encode_header(codec_state, opcode, len, out, out_cap, &hdr);
+    if (r != WEN_OK) return r;
+    if (out_cap < hdr + len) return WEN_ERR_OVERFLOW;
+
+    memcpy((uint8_t *)out + hdr, data, len);
 
     *out_len = hdr + len;
     return WEN_OK;
@@ -202,131 +223,182 @@ static const wen_codec ws_codec = {
     .handshake = ws_handshake,
     .decode = ws_decode,
     .encode = ws_encode,
+    .encode_header = ws_encode_header,
 };
 
+static long sock_result(long n) {
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return WEN_IO_WOULD_BLOCK;
+    return n;
+}
 static long sock_read(void *user, void *buf, unsigned long len) {
     int fd = *(int *)user;
-    return read(fd, buf, len);
+    return sock_result(read(fd, buf, len));
 }
 static long sock_write(void *user, const void *buf, unsigned long len) {
     int fd = *(int *)user;
-    return write(fd, buf, len);
+    return sock_result(write(fd, buf, len));
+}
+static long sock_readv(void *user, const wen_iovec *iov, unsigned iovcnt) {
+    int fd = *(int *)user;
+    // wen never hands over more than WEN_IOV_MAX entries.
+    struct iovec v[WEN_IOV_MAX];
+    for (unsigned i = 0; i < iovcnt; i++) {
+        v[i].iov_base = iov[i].base;
+        v[i].iov_len  = iov[i].len;
+    }
+    return sock_result(readv(fd, v, (int)iovcnt));
+}
+static long sock_writev(void *user, const wen_iovec *iov, unsigned iovcnt) {
+    int fd = *(int *)user;
+    struct iovec v[WEN_IOV_MAX];
+    for (unsigned i = 0; i < iovcnt; i++) {
+        v[i].iov_base = iov[i].base;
+        v[i].iov_len  = iov[i].len;
+    }
+    return sock_result(writev(fd, v, (int)iovcnt));
 }
 
-void run_ws(int sockfd) {
+typedef struct {
+    int fd;
     wen_link link;
-    wen_event ev;
-    wen_io io = {.user = &sockfd, .read = sock_read, .write = sock_write};
-    wen_link_init(&link, io);
+    ws_codec_state state;
+} ws_client;
 
-    unsigned ecode = WEN_EV_CLOSE;
-    unsigned opcode = WEN_WS_OP_CLOSE;
+static void client_free(ws_client *c) {
+    wen_link_deinit(&c->link);
+    close(c->fd);
+    free(c);
+}
 
-    ws_codec_state state = {
-        .link = &link
+static void on_accept(wen_shard *shard, int fd) {
+    ws_client *c = calloc(1, sizeof(*c));
+    if (!c) {
+        close(fd);
+        return;
+    }
+    c->fd = fd;
+    c->state.link = &c->link;
+
+    wen_io io = {
+        .user   = &c->fd,
+        .read   = sock_read,
+        .write  = sock_write,
+        .readv  = sock_readv,
+        .writev = sock_writev
     };
-    wen_link_attach_codec(&link, &ws_codec, &state);
-    for (;;) {
-        if (!wen_poll(&link, &ev)) continue;
-
-        switch (ev.type) {
+    if (wen_link_init(&c->link, io) != WEN_OK) {
+        close(fd);
+        free(c);
+        return;
+    }
+    wen_link_attach_codec(&c->link, &ws_codec, &c->state);
+    c->link.user_data = c;
 
-        case WEN_EV_OPEN:
-            printf("[WS] Handshake complete\n");
-            wen_send(&link, WEN_WS_OP_TEXT, "Hello from wen!", 15);
-            break;
+    if (wen_loop_add(&shard->loop, &c->link, fd) != WEN_OK) {
+        client_free(c);
+        return;
+    }
+    // Five seconds to finish the handshake, a ping every 20 and a minute
+    // of silence at most.
+    wen_link_set_timeouts(&c->link, 5000, 60000, 20000);
+    wen_timers_add(&shard->timers, &c->link);
+    printf("Client connected on shard %u!\n", shard->index);
+}
 
-        case WEN_EV_SLICE: {
-            uint8_t *b = (uint8_t *)ev.as.slice.data;
+static void handle_event(wen_link *link, wen_event ev) {
+    ws_client *c = link->user_data;
 
-            uint64_t plen = b[1] & 0x7F;
-            uint8_t *mask = b + 2;
-            uint8_t *payload = b + 6;
+    switch (ev.type) {
 
-            for (uint64_t i = 0; i < plen; i++)
-                payload[i] ^= mask[i & 3];
+    case WEN_EV_OPEN:
+        printf("[WS] Handshake complete\n");
+        wen_send(link, WEN_WS_OP_TEXT, "Hello from wen!", 15);
+        break;
 
-            if (opcode == WEN_WS_OP_PING) {
-                wen_send(&link, WEN_WS_OP_PONG, payload, plen);
-                wen_release(&link, ev.as.slice);
-                break;
-            }
+    case WEN_EV_SLICE: {
+        uint8_t *b = (uint8_t *)ev.as.slice.data;
 
-            if (opcode == WEN_WS_OP_TEXT) {
-                if (plen && payload[plen - 1] == '\n')
-                    plen--;
+        uint8_t opcode = b[0] & 0x0F;
+        uint64_t plen = b[1] & 0x7F;
+        uint8_t *mask = b + 2;
+        uint8_t *payload = b + 6;
 
-                printf("[WS] %.*s\n", (int)plen, payload);
-                wen_send(&link, WEN_WS_OP_TEXT, payload, plen);
-            }
+        for (uint64_t i = 0; i < plen; i++)
+            payload[i] ^= mask[i & 3];
 
-            wen_release(&link, ev.as.slice);
+        if (opcode == WEN_WS_OP_PING) {
+            wen_send(link, WEN_WS_OP_PONG, payload, plen);
+            wen_release(link, ev.as.slice);
             break;
         }
 
-        case WEN_EV_CLOSE:
-            printf("[WS] Connection closed\n");
-            ecode = WEN_EV_CLOSE;
-            goto next_client;
+        if (opcode == WEN_WS_OP_TEXT) {
+            if (plen && payload[plen - 1] == '\n')
+                plen--;
 
-        case WEN_EV_ERROR:
-            fprintf(stderr, "[WS] Error: %d\n", ev.as.error);
-            ecode = WEN_EV_ERROR;
-            goto next_client;
-
-        case WEN_EV_PING:
-            printf("[PING]\n");
-            break;
+            printf("[WS] %.*s\n", (int)plen, payload);
+            wen_send(link, WEN_WS_OP_TEXT, payload, plen);
+        }
 
-        case WEN_EV_PONG:
-            printf("[PONG]\n");
-            break;
+        wen_release(link, ev.as.slice);
+        break;
+    }
 
-        default:
+    case WEN_EV_CLOSE:
+        // The loop has already let go of the link.
+        printf("[WS] Connection closed\n");
+        client_free(c);
+        break;
+
+    case WEN_EV_ERROR:
+        // Hang up; the loop reports WEN_EV_CLOSE once the socket is shut.
+        fprintf(stderr, "[WS] Error: %d\n", ev.as.error);
+        shutdown(c->fd, SHUT_RDWR);
+        break;
+
+    case WEN_EV_TIMEOUT:
+        if (ev.as.timeout == WEN_TIMEOUT_PING) {
+            wen_send(link, WEN_WS_OP_PING, "", 0);
             break;
         }
-    }
+        printf("[WS] Timed out\n");
+        shutdown(c->fd, SHUT_RDWR);
+        break;
 
-next_client:
-    wen_close(&link, ecode, opcode);
-    ;
-}
+    case WEN_EV_PING:
+        printf("[PING]\n");
+        break;
 
-int main(void) {
-    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    case WEN_EV_PONG:
+        printf("[PONG]\n");
+        break;
 
-    int opt = 1;
-    if (setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) <
-        0) {
-        perror("setsockopt");
-        exit(1);
+    default:
+        break;
     }
+}
 
-    struct sockaddr_in addr = {0};
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(8001);
-    addr.sin_addr.s_addr = INADDR_ANY;
+static void on_event(wen_shard *shard, wen_loop_event *ev) {
+    (void)shard;
+    handle_event(ev->link, ev->ev);
+}
 
-    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
-        perror("bind");
-        exit(1);
-    }
+int main(void) {
+    // One thread, loop and SO_REUSEPORT listener per CPU.
+    wen_runtime rt;
+    wen_runtime_config cfg = {
+        .port = 8001,
+        .pin = true,
+        .on_accept = on_accept,
+        .on_event = on_event,
+    };
 
-    if (listen(listen_fd, 5) < 0) {
-        perror("listen");
+    if (wen_runtime_start(&rt, &cfg) != WEN_OK) {
+        perror("wen_runtime_start");
         exit(1);
     }
-    printf("Server listening on port 8001...\n");
+    printf("Server listening on port 8001 with %u shards...\n", rt.count);
 
-    while (1) {
-        int client_fd = accept(listen_fd, NULL, NULL);
-        if (client_fd < 0) {
-            perror("accept");
-            continue;
-        }
-
-        printf("Client connected!\n");
-        run_ws(client_fd);
-        close(client_fd);
-    }
+    for (;;) pause();
 }
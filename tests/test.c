@@ -111,6 +111,32 @@ static void rebuild_self(const char *src, const char *exe)
 #include "test_remote_close_generates_event_once.c"
 #include "test_tx_flush_before_rx.c"
 #include "test_slice_size_limit.c"
+#include "test_rx_ring_no_compaction.c"
+#include "test_tx_cursor_partial_write.c"
+#include "test_vectored_io.c"
+#include "test_send_ref_zero_copy.c"
+#include "test_slice_zero_copy.c"
+#include "test_slice_release_any_order.c"
+#include "test_poll_batch.c"
+#include "test_read_drain.c"
+#include "test_io_would_block.c"
+#include "test_link_init_ex.c"
+#include "test_buffer_pool.c"
+#include "test_link_pool.c"
+#include "test_region.c"
+#include "test_budget.c"
+#include "test_arena_chain.c"
+#include "test_slice_scratch.c"
+#include "test_link_table.c"
+#include "test_loop.c"
+#include "test_uring.c"
+#include "test_runtime.c"
+#include "test_timers.c"
+#include "test_loop_fair.c"
+#include "test_loop_spin.c"
+#include "test_poll_interest.c"
+#include "test_dispatch.c"
+#include "test_buffer_pool_loop.c"
 
 /* Runner */
 
@@ -172,6 +198,32 @@ int main(int argc, char *argv[]) {
     RUN_TEST(test_remote_close_generates_event_once);
     RUN_TEST(test_tx_flush_before_rx);
     RUN_TEST(test_slice_size_limit);
+    RUN_TEST(test_rx_ring_no_compaction);
+    RUN_TEST(test_tx_cursor_partial_write);
+    RUN_TEST(test_vectored_io);
+    RUN_TEST(test_send_ref_zero_copy);
+    RUN_TEST(test_slice_zero_copy);
+    RUN_TEST(test_slice_release_any_order);
+    RUN_TEST(test_poll_batch);
+    RUN_TEST(test_read_drain);
+    RUN_TEST(test_io_would_block);
+    RUN_TEST(test_link_init_ex);
+    RUN_TEST(test_buffer_pool);
+    RUN_TEST(test_link_pool);
+    RUN_TEST(test_region);
+    RUN_TEST(test_budget);
+    RUN_TEST(test_arena_chain);
+    RUN_TEST(test_slice_scratch);
+    RUN_TEST(test_link_table);
+    RUN_TEST(test_loop);
+    RUN_TEST(test_uring);
+    RUN_TEST(test_runtime);
+    RUN_TEST(test_timers);
+    RUN_TEST(test_loop_fair);
+    RUN_TEST(test_loop_spin);
+    RUN_TEST(test_poll_interest);
+    RUN_TEST(test_dispatch);
+    RUN_TEST(test_buffer_pool_loop);
 
     printf(C_BOLD "Summary:\n" C_RESET);
     printf("  Tests run:    %d\n", tests_run);
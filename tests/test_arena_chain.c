@@ -0,0 +1,89 @@
+#ifdef TEST
+static void test_arena_chain(void)
+{
+    static unsigned char base[64];
+    wen_page_pool pages;
+    wen_arena arena;
+
+    ASSERT(wen_page_pool_init(&pages, 128, 3) == WEN_OK);
+    wen_arena_bind(&arena, base, sizeof(base));
+    wen_arena_chain(&arena, &pages);
+
+    unsigned char *a = wen_arena_alloc(&arena, 48);
+    ASSERT(a == base);
+    wen_arena_snapshot snap = arena.used;
+
+    // Past the base block, allocations continue in pages taken from the pool.
+    unsigned char *b = wen_arena_alloc(&arena, 48);
+    unsigned char *c = wen_arena_alloc(&arena, 48);
+    unsigned char *d = wen_arena_alloc(&arena, 48);
+    ASSERT(b && c && d);
+    ASSERT(c == b + 48);
+    ASSERT(wen_page_pool_available(&pages) == 1);
+    ASSERT(arena.used > arena.capacity);
+
+    memset(a, 'a', 48);
+    memset(b, 'b', 48);
+    memset(c, 'c', 48);
+    memset(d, 'd', 48);
+    ASSERT(a[47] == 'a' && b[47] == 'b' && c[0] == 'c' && d[47] == 'd');
+
+    // Larger than a page never fits.
+    ASSERT(wen_arena_alloc(&arena, 256) == NULL);
+
+    // Room is measured in the newest page, and a free page still counts.
+    ASSERT(WEN_ARENA_REMAINING(&arena) == wen__page_capacity(&pages) - 48);
+    ASSERT(WEN_ARENA_CAN_ALLOC(&arena, WEN_ARENA_REMAINING(&arena)));
+    ASSERT(WEN_ARENA_CAN_ALLOC(&arena, wen__page_capacity(&pages)));
+    ASSERT(!WEN_ARENA_CAN_ALLOC(&arena, 256));
+
+    // Resetting below a page boundary returns the pages.
+    wen_arena_snapshot in_page = arena.used;
+    ASSERT(wen_arena_alloc(&arena, 8) != NULL);
+    wen_arena_reset(&arena, in_page);
+    ASSERT(wen_page_pool_available(&pages) == 1);
+    wen_arena_reset(&arena, snap);
+    ASSERT(wen_page_pool_available(&pages) == 3);
+    ASSERT(arena.used == snap);
+    ASSERT(wen_arena_alloc(&arena, 8) == base + 48);
+
+    // A link with a small arena copies slices into chained pages.
+    block_io bio = {0};
+    wen_link link;
+    wen_event ev;
+    wen_slice held[3];
+
+    wen_io io = {.user=&bio, .read=block_read, .write=block_write};
+    wen_link_config cfg = {.arena_size=128, .arena_pages=&pages};
+    ASSERT(wen_link_init_ex(&link, io, &cfg) == WEN_OK);
+    wen_link_attach_codec(&link, &framed_codec, &link);
+    ASSERT(wen_link_set_slice_limit(&link, 3) == WEN_OK);
+
+    while (!wen_poll(&link, &ev));
+    ASSERT(ev.type == WEN_EV_OPEN);
+
+    unsigned char payload[100];
+    for (int i = 0; i < 3; i++) {
+        memset(payload, '0' + i, sizeof(payload));
+        fake_feed(&bio.base, WEN_WS_OP_BINARY, payload, sizeof(payload));
+    }
+    for (int i = 0; i < 3; i++) {
+        while (!wen_poll(&link, &ev)) bio.read_blocked = 1;
+        ASSERT(ev.type == WEN_EV_SLICE);
+        ASSERT(ev.as.slice.len == 102);
+        held[i] = ev.as.slice;
+    }
+    ASSERT(wen_page_pool_available(&pages) == 1);
+    for (int i = 0; i < 3; i++)
+        ASSERT(((const unsigned char *)held[i].data)[101] == '0' + i);
+
+    wen_release(&link, held[1]);
+    wen_release(&link, held[2]);
+    ASSERT(wen_page_pool_available(&pages) == 3);
+    wen_release(&link, held[0]);
+    ASSERT(link.arena.used == 0);
+
+    wen_link_deinit(&link);
+    wen_page_pool_free(&pages);
+}
+#endif // TEST
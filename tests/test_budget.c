@@ -0,0 +1,60 @@
+#ifdef TEST
+static void test_budget(void)
+{
+    fake_io fio = {0};
+    wen_budget budget;
+    wen_link links[3];
+
+    wen_io io = {.user=&fio, .read=fake_read, .write=fake_write};
+    wen_link_config cfg = {.rx_size=512, .tx_size=512};
+    unsigned long size = wen_link_mem_size(&cfg);
+
+    wen_budget_init(&budget, 2 * size + 100);
+    cfg.budget = &budget;
+
+    // New links are refused once their buffers would exceed the budget.
+    ASSERT(wen_link_init_ex(&links[0], io, &cfg) == WEN_OK);
+    ASSERT(wen_link_init_ex(&links[1], io, &cfg) == WEN_OK);
+    ASSERT(budget.used == 2 * size);
+    ASSERT(wen_link_init_ex(&links[2], io, &cfg) == WEN_ERR_BUDGET);
+    ASSERT(budget.used == 2 * size);
+
+    // Other memory, e.g. codec state, can be accounted too.
+    ASSERT(wen_budget_charge(&budget, 100) == WEN_OK);
+    ASSERT(wen_budget_charge(&budget, 1) == WEN_ERR_BUDGET);
+    wen_budget_release(&budget, 100);
+
+    wen_link_deinit(&links[0]);
+    ASSERT(budget.used == size);
+    ASSERT(wen_link_init_ex(&links[2], io, &cfg) == WEN_OK);
+    ASSERT(budget.peak == 2 * size + 100);
+    wen_link_deinit(&links[1]);
+    wen_link_deinit(&links[2]);
+    ASSERT(budget.used == 0);
+
+    // Pooled links are charged only while they hold a block.
+    wen_buffer_pool pool;
+    wen_link_config sizes = {.rx_size=512, .tx_size=512};
+    ASSERT(wen_buffer_pool_init(&pool, &sizes, 2) == WEN_OK);
+    wen_budget_init(&budget, pool.block_size);
+    wen_link_config pooled = {.pool=&pool, .budget=&budget};
+
+    for (int i = 0; i < 2; i++) {
+        ASSERT(wen_link_init_ex(&links[i], io, &pooled) == WEN_OK);
+        wen_link_attach_codec(&links[i], &vec_codec, &links[i]);
+        links[i].state = WEN_LINK_OPEN;
+    }
+    ASSERT(budget.used == 0);
+
+    ASSERT(wen_send(&links[0], WEN_WS_OP_TEXT, "a", 1) == WEN_OK);
+    ASSERT(budget.used == pool.block_size);
+    ASSERT(wen_send(&links[1], WEN_WS_OP_TEXT, "b", 1) == WEN_ERR_BUDGET);
+    ASSERT(wen_buffer_pool_available(&pool) == 1);
+
+    wen_link_deinit(&links[0]);
+    ASSERT(budget.used == 0);
+    ASSERT(wen_send(&links[1], WEN_WS_OP_TEXT, "b", 1) == WEN_OK);
+    wen_link_deinit(&links[1]);
+    wen_buffer_pool_free(&pool);
+}
+#endif // TEST
@@ -0,0 +1,77 @@
+#ifdef TEST
+static void test_buffer_pool(void)
+{
+    static block_io bio[3];
+    wen_buffer_pool pool;
+    wen_link links[3];
+    wen_event ev;
+    wen_slice held[2];
+
+    wen_link_config sizes = {.rx_size=512, .tx_size=512};
+    ASSERT(wen_buffer_pool_init(&pool, &sizes, 2) == WEN_OK);
+    ASSERT(wen_buffer_pool_available(&pool) == 2);
+
+    // Links start out without buffers and hand them back whenever idle.
+    memset(bio, 0, sizeof(bio));
+    wen_link_config cfg = {.pool=&pool};
+    for (int i = 0; i < 3; i++) {
+        wen_io io = {.user=&bio[i], .read=block_read, .write=block_write};
+        ASSERT(wen_link_init_ex(&links[i], io, &cfg) == WEN_OK);
+        ASSERT(!wen_link_has_buffers(&links[i]));
+        wen_link_attach_codec(&links[i], &vec_codec, &links[i]);
+
+        while (!wen_poll(&links[i], &ev));
+        ASSERT(ev.type == WEN_EV_OPEN);
+        ASSERT(links[i].rx_cap == 512);
+
+        bio[i].read_blocked = 1;
+        ASSERT(!wen_poll(&links[i], &ev));
+        ASSERT(!wen_link_has_buffers(&links[i]));
+    }
+    ASSERT(wen_buffer_pool_available(&pool) == 2);
+
+    // A block is held while a slice is outstanding.
+    for (int i = 0; i < 2; i++) {
+        bio[i].read_blocked = 0;
+        fake_feed(&bio[i].base, WEN_WS_OP_TEXT, (unsigned char *)"hey", 3);
+        while (!wen_poll(&links[i], &ev));
+        ASSERT(ev.type == WEN_EV_SLICE);
+        ASSERT(wen_link_has_buffers(&links[i]));
+        held[i] = ev.as.slice;
+    }
+    ASSERT(wen_buffer_pool_available(&pool) == 0);
+
+    // With the pool exhausted the third link neither reads nor sends.
+    bio[2].read_blocked = 0;
+    fake_feed(&bio[2].base, WEN_WS_OP_TEXT, (unsigned char *)"wait", 4);
+    unsigned long in_pos = bio[2].base.in_pos;
+    ASSERT(!wen_poll(&links[2], &ev));
+    ASSERT(bio[2].base.in_pos == in_pos);
+    ASSERT(wen_send(&links[2], WEN_WS_OP_TEXT, "x", 1) == WEN_ERR_OVERFLOW);
+
+    // Releasing a slice gives the block back right away.
+    bio[0].read_blocked = 1;
+    wen_release(&links[0], held[0]);
+    ASSERT(!wen_link_has_buffers(&links[0]));
+    ASSERT(wen_buffer_pool_available(&pool) == 1);
+
+    while (!wen_poll(&links[2], &ev));
+    ASSERT(ev.type == WEN_EV_SLICE);
+    ASSERT(memcmp((const char *)ev.as.slice.data + 2, "wait", 4) == 0);
+    wen_release(&links[2], ev.as.slice);
+
+    // Pending output keeps the block until it is flushed.
+    bio[2].read_blocked = 1;
+    ASSERT(wen_send(&links[2], WEN_WS_OP_TEXT, "ok", 2) == WEN_OK);
+    ASSERT(wen_buffer_pool_available(&pool) == 0);
+    ASSERT(!wen_poll(&links[2], &ev));
+    ASSERT(bio[2].base.out_len == 4);
+    ASSERT(!wen_link_has_buffers(&links[2]));
+
+    wen_release(&links[1], held[1]);
+    ASSERT(wen_buffer_pool_available(&pool) == 2);
+
+    for (int i = 0; i < 3; i++) wen_link_deinit(&links[i]);
+    wen_buffer_pool_free(&pool);
+}
+#endif // TEST
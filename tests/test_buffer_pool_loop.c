@@ -0,0 +1,67 @@
+#ifdef TEST
+static void test_buffer_pool_loop(void)
+{
+    wen_loop loop;
+    wen_result r = wen_loop_init(&loop);
+    if (r == WEN_ERR_UNSUPPORTED) return;
+    ASSERT(r == WEN_OK);
+
+#if defined(__linux__)
+    int sv[2][2];
+    wen_buffer_pool pool;
+    wen_link links[2];
+    wen_loop_event out[8];
+
+    wen_link_config sizes = {.rx_size=512, .tx_size=512};
+    ASSERT(wen_buffer_pool_init(&pool, &sizes, 1) == WEN_OK);
+    wen_link_config cfg = {.pool=&pool};
+
+    for (int i = 0; i < 2; i++) {
+        ASSERT(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv[i]) == 0);
+        wen_io io = {.user=&sv[i][0], .read=fd_read, .write=fd_write};
+        ASSERT(wen_link_init_ex(&links[i], io, &cfg) == WEN_OK);
+        wen_link_attach_codec(&links[i], &framed_codec, &links[i]);
+        ASSERT(wen_loop_add(&loop, &links[i], sv[i][0]) == WEN_OK);
+        ASSERT(write(sv[i][1], "x", 1) == 1);
+    }
+    for (int opened = 0, tries = 0; opened < 2 && tries < 8; tries++) {
+        unsigned n = wen_loop_run(&loop, out, 8, 1000);
+        for (unsigned i = 0; i < n; i++) opened += out[i].ev.type == WEN_EV_OPEN;
+    }
+    // Links that finish the handshake give the block back right away.
+    ASSERT(wen_buffer_pool_available(&pool) == 1);
+
+    // The first link holds the only block while its slice is out.
+    ASSERT(write(sv[0][1], "\x81\x01" "a", 3) == 3);
+    int i = loop_until(&loop, out, 8, WEN_EV_SLICE);
+    ASSERT(i >= 0 && out[i].link == &links[0]);
+    wen_slice held = out[i].ev.as.slice;
+    ASSERT(wen_buffer_pool_available(&pool) == 0);
+
+    // The second link's readiness is used up without a block to read into.
+    ASSERT(write(sv[1][1], "\x81\x01" "b", 3) == 3);
+    ASSERT(wen_loop_run(&loop, out, 8, 100) == 0);
+    ASSERT(wen_loop_run(&loop, out, 8, 0) == 0);
+    ASSERT(links[1].pool_waiting);
+
+    // Handing the block back wakes it without a new edge from the peer.
+    wen_release(&links[0], held);
+    ASSERT(!links[1].pool_waiting);
+    unsigned n = wen_loop_run(&loop, out, 8, 0);
+    ASSERT(n == 1);
+    ASSERT(out[0].link == &links[1] && out[0].ev.type == WEN_EV_SLICE);
+    ASSERT(memcmp((const char *)out[0].ev.as.slice.data + 2, "b", 1) == 0);
+    wen_release(&links[1], out[0].ev.as.slice);
+    ASSERT(wen_buffer_pool_available(&pool) == 1);
+
+    for (int k = 0; k < 2; k++) {
+        wen_loop_remove(&loop, &links[k]);
+        wen_link_deinit(&links[k]);
+        close(sv[k][0]);
+        close(sv[k][1]);
+    }
+    wen_buffer_pool_free(&pool);
+#endif
+    wen_loop_free(&loop);
+}
+#endif
@@ -0,0 +1,99 @@
+#ifdef TEST
+static int dispatch_opened, dispatch_slices, dispatch_closed, dispatch_nested;
+static unsigned char dispatch_last[8];
+
+static void dispatch_open(wen_link *link)
+{
+    WEN_UNUSED(link);
+    dispatch_opened++;
+}
+
+static void dispatch_slice(wen_link *link, wen_slice slice)
+{
+    dispatch_slices++;
+    memcpy(dispatch_last, slice.data, WEN_MIN(slice.len, sizeof(dispatch_last)));
+
+    // Nested dispatches are refused; replies are fine.
+    dispatch_nested += wen_dispatch(link, 8);
+    wen_send(link, WEN_WS_OP_TEXT, "ok", 2);
+    wen_release(link, slice);
+}
+
+static void dispatch_close(wen_link *link)
+{
+    WEN_UNUSED(link);
+    dispatch_closed++;
+}
+
+static const wen_handlers dispatch_handlers = {
+    .on_open = dispatch_open,
+    .on_slice = dispatch_slice,
+    .on_close = dispatch_close,
+};
+
+static void test_dispatch(void)
+{
+    fake_io fio = {0};
+    wen_link link;
+
+    wen_io io = {.user=&fio, .read=fake_read, .write=fake_write};
+    ASSERT(wen_link_init(&link, io) == WEN_OK);
+    wen_link_attach_codec(&link, &framed_codec, &link);
+    wen_link_set_handlers(&link, &dispatch_handlers);
+
+    fake_feed(&fio, WEN_WS_OP_TEXT, (unsigned char *)"one", 3);
+    fake_feed(&fio, WEN_WS_OP_TEXT, (unsigned char *)"two", 3);
+    ASSERT(wen_dispatch(&link, 16) == 1);
+    ASSERT(dispatch_opened == 1);
+
+    // Slices go straight to the handler without passing through the queue.
+    unsigned tail = link.evq.tail;
+    ASSERT(wen_dispatch(&link, 16) == 2);
+    ASSERT(dispatch_slices == 2);
+    ASSERT(memcmp(dispatch_last, "\x81\x03two", 5) == 0);
+    ASSERT(link.evq.tail == tail);
+    ASSERT(dispatch_nested == 0);
+    ASSERT(wen_link_slices_outstanding(&link) == 0);
+
+    // Replies from handlers go out on the next pass.
+    ASSERT(link.tx_len == 8);
+    ASSERT(wen_dispatch(&link, 16) == 0);
+    ASSERT(fio.out_len == 8);
+    ASSERT(wen_dispatch(&link, 16) == 1);
+    ASSERT(dispatch_closed == 1);
+    ASSERT(link.state == WEN_LINK_CLOSED);
+
+    // Without a slice handler, slices are released on their own.
+    static const wen_handlers none = {0};
+    fake_io fio2 = {0};
+    io.user = &fio2;
+    ASSERT(wen_link_init(&link, io) == WEN_OK);
+    wen_link_attach_codec(&link, &framed_codec, &link);
+    wen_link_set_handlers(&link, &none);
+    fake_feed(&fio2, WEN_WS_OP_TEXT, (unsigned char *)"x", 1);
+    wen_dispatch(&link, 16);
+    wen_dispatch(&link, 16);
+    ASSERT(link.slice_next == 1);
+    ASSERT(wen_link_slices_outstanding(&link) == 0);
+    wen_link_deinit(&link);
+
+    // Plain polling keeps returning slices as events, handlers or not.
+    fake_io fio3 = {0};
+    io.user = &fio3;
+    ASSERT(wen_link_init(&link, io) == WEN_OK);
+    wen_link_attach_codec(&link, &framed_codec, &link);
+    wen_link_set_handlers(&link, &dispatch_handlers);
+    fake_feed(&fio3, WEN_WS_OP_TEXT, (unsigned char *)"three", 5);
+
+    wen_event ev;
+    int slices = dispatch_slices;
+    while (!wen_poll(&link, &ev));
+    ASSERT(ev.type == WEN_EV_OPEN);
+    while (!wen_poll(&link, &ev));
+    ASSERT(ev.type == WEN_EV_SLICE);
+    ASSERT(memcmp((const char *)ev.as.slice.data + 2, "three", 5) == 0);
+    ASSERT(dispatch_slices == slices);
+    wen_release(&link, ev.as.slice);
+    wen_link_deinit(&link);
+}
+#endif
@@ -0,0 +1,61 @@
+#ifdef TEST
+typedef struct {
+    fake_io base;
+    int read_blocked;
+    int write_blocked;
+} block_io;
+
+static long block_read(void *user, void *buf, unsigned long len)
+{
+    block_io *io = user;
+    if (io->read_blocked) return WEN_IO_WOULD_BLOCK;
+    return fake_read(&io->base, buf, len);
+}
+
+static long block_write(void *user, const void *buf, unsigned long len)
+{
+    block_io *io = user;
+    if (io->write_blocked) return WEN_IO_WOULD_BLOCK;
+    return fake_write(&io->base, buf, len);
+}
+
+static void test_io_would_block(void)
+{
+    block_io bio = {0};
+    wen_link link;
+    wen_event ev;
+
+    wen_io io = {.user=&bio, .read=block_read, .write=block_write};
+    ASSERT(wen_link_init(&link, io) == WEN_OK);
+    wen_link_attach_codec(&link, &framed_codec, &link);
+
+    while (!wen_poll(&link, &ev));
+    ASSERT(ev.type == WEN_EV_OPEN);
+
+    // A congested write is not an error; the backlog stays queued and the
+    // poll still reads.
+    bio.write_blocked = 1;
+    fake_feed(&bio.base, WEN_WS_OP_TEXT, (unsigned char *)"in", 2);
+    ASSERT(wen_send(&link, WEN_WS_OP_TEXT, "out", 3) == WEN_OK);
+    while (!wen_poll(&link, &ev));
+    ASSERT(ev.type == WEN_EV_SLICE);
+    ASSERT(wen_link_tx_blocked(&link));
+    ASSERT(link.tx_len == 5);
+    ASSERT(bio.base.out_len == 0);
+    wen_release(&link, ev.as.slice);
+
+    // Nothing to read is not end of stream either.
+    bio.read_blocked = 1;
+    ASSERT(!wen_poll(&link, &ev));
+    ASSERT(wen_link_rx_drained(&link));
+    ASSERT(link.state == WEN_LINK_OPEN);
+
+    // Once writable, the backlog is flushed.
+    bio.write_blocked = 0;
+    ASSERT(!wen_poll(&link, &ev));
+    ASSERT(!wen_link_tx_blocked(&link));
+    ASSERT(link.tx_len == 0);
+    ASSERT(bio.base.out_len == 5);
+    ASSERT(memcmp(bio.base.out + 2, "out", 3) == 0);
+}
+#endif // TEST
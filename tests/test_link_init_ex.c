@@ -0,0 +1,63 @@
+#ifdef TEST
+static void test_link_init_ex(void)
+{
+    static unsigned char mem[2048];
+    fake_io fio = {0};
+    wen_link link;
+    wen_event ev;
+
+    wen_io io = {.user=&fio, .read=fake_read, .write=fake_write};
+    wen_link_config cfg = {.rx_size=512, .tx_size=512, .mem=mem, .mem_size=sizeof(mem)};
+
+    ASSERT(wen_link_mem_size(&cfg) == 2048);
+
+    // Caller memory that is too small, or buffers below the minimum, are rejected.
+    cfg.mem_size = 1024;
+    ASSERT(wen_link_init_ex(&link, io, &cfg) == WEN_ERR_OVERFLOW);
+    cfg.mem_size = sizeof(mem);
+    cfg.rx_size = WEN_MIN_BUFFER - 1;
+    ASSERT(wen_link_init_ex(&link, io, &cfg) == WEN_ERR_STATE);
+    cfg.rx_size = 512;
+
+    // Both buffers and the arena are carved out of the caller's block.
+    ASSERT(wen_link_init_ex(&link, io, &cfg) == WEN_OK);
+    ASSERT(link.rx_buf == mem && link.rx_cap == 512);
+    ASSERT(link.tx_buf == mem + 512 && link.tx_cap == 512);
+    ASSERT(link.arena.base == mem + 1024 && link.arena.capacity == 1024);
+    ASSERT(!link.owns_mem);
+
+    wen_link_attach_codec(&link, &vec_codec, &link);
+    while (!wen_poll(&link, &ev));
+    ASSERT(ev.type == WEN_EV_OPEN);
+
+    fake_feed(&fio, WEN_WS_OP_TEXT, (unsigned char *)"tiny", 4);
+    while (!wen_poll(&link, &ev));
+    ASSERT(ev.type == WEN_EV_SLICE);
+    ASSERT(memcmp((const char *)ev.as.slice.data + 2, "tiny", 4) == 0);
+    wen_release(&link, ev.as.slice);
+
+    // The transmit buffer is bounded by the configured size.
+    unsigned char payload[100] = {0};
+    unsigned sent = 0;
+    while (wen_send(&link, WEN_WS_OP_BINARY, payload, sizeof(payload)) == WEN_OK) sent++;
+    ASSERT(sent == 512 / (2 + sizeof(payload)));
+    ASSERT(!wen__poll_flush_tx(&link, &ev));
+    ASSERT(link.tx_len == 0);
+
+    // The caller's memory stays attached on close.
+    fake_close(&fio);
+    while (!wen_poll(&link, &ev));
+    ASSERT(ev.type == WEN_EV_CLOSE);
+    ASSERT(link.rx_buf == mem && link.tx_cap == 512);
+    ASSERT(wen_send(&link, WEN_WS_OP_TEXT, "x", 1) == WEN_ERR_CLOSED);
+
+    // Without memory wen allocates one block of the requested sizes.
+    wen_link_config big = {.rx_size=256 * 1024, .tx_size=256 * 1024};
+    ASSERT(wen_link_init_ex(&link, io, &big) == WEN_OK);
+    ASSERT(link.owns_mem);
+    ASSERT(link.rx_cap == 256 * 1024 && link.tx_cap == 256 * 1024);
+    ASSERT(link.arena.capacity == 512 * 1024);
+    wen_link_deinit(&link);
+    ASSERT(link.mem == NULL);
+}
+#endif // TEST
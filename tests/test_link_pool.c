@@ -0,0 +1,78 @@
+#ifdef TEST
+static void test_link_pool(void)
+{
+    fake_io fio[2];
+    wen_link_pool pool;
+    wen_event ev;
+
+    memset(fio, 0, sizeof(fio));
+    wen_io io0 = {.user=&fio[0], .read=fake_read, .write=fake_write};
+    wen_io io1 = {.user=&fio[1], .read=fake_read, .write=fake_write};
+
+    wen_link_config cfg = {.rx_size=512, .tx_size=512};
+    ASSERT(wen_link_pool_init(&pool, &cfg, 2) == WEN_OK);
+
+    wen_link *a = wen_link_pool_acquire(&pool, io0);
+    wen_link *b = wen_link_pool_acquire(&pool, io1);
+    ASSERT(a && b && a != b);
+    ASSERT(a->rx_cap == 512 && a->tx_cap == 512);
+    ASSERT(wen_link_pool_acquire(&pool, io0) == NULL);
+
+    unsigned char *rx_buf = a->rx_buf;
+    unsigned char *arena = a->arena.base;
+
+    wen_link_attach_codec(a, &framed_codec, a);
+    while (!wen_poll(a, &ev));
+    ASSERT(ev.type == WEN_EV_OPEN);
+    fake_feed(&fio[0], WEN_WS_OP_TEXT, (unsigned char *)"one", 3);
+    while (!wen_poll(a, &ev));
+    ASSERT(ev.type == WEN_EV_SLICE);
+    wen_release(a, ev.as.slice);
+    fake_close(&fio[0]);
+    while (!wen_poll(a, &ev));
+    ASSERT(ev.type == WEN_EV_CLOSE);
+
+    // The link comes back with its buffers and arena in place and fresh control fields.
+    wen_link_pool_release(&pool, a);
+    memset(&fio[0], 0, sizeof(fio[0]));
+    wen_link *c = wen_link_pool_acquire(&pool, io0);
+    ASSERT(c == a);
+    ASSERT(c->state == WEN_LINK_INIT);
+    ASSERT(c->rx_buf == rx_buf && c->arena.base == arena);
+    ASSERT(c->rx_len == 0 && c->arena.used == 0 && !c->close_queued);
+    ASSERT(wen_link_slices_outstanding(c) == 0 && wen_evq_len(&c->evq) == 0);
+
+    wen_link_attach_codec(c, &framed_codec, c);
+    while (!wen_poll(c, &ev));
+    ASSERT(ev.type == WEN_EV_OPEN);
+    fake_feed(&fio[0], WEN_WS_OP_TEXT, (unsigned char *)"two", 3);
+    while (!wen_poll(c, &ev));
+    ASSERT(ev.type == WEN_EV_SLICE);
+    ASSERT(memcmp((const char *)ev.as.slice.data + 2, "two", 3) == 0);
+    wen_release(c, ev.as.slice);
+
+    wen_link_pool_release(&pool, c);
+    wen_link_pool_release(&pool, b);
+    wen_link_pool_free(&pool);
+
+    // Links can borrow their buffers from a buffer pool instead.
+    wen_buffer_pool buffers;
+    ASSERT(wen_buffer_pool_init(&buffers, &cfg, 1) == WEN_OK);
+    wen_link_config shared = {.pool=&buffers};
+    ASSERT(wen_link_pool_init(&pool, &shared, 4) == WEN_OK);
+    ASSERT(wen_link_pool_mem_size(&shared, 4) == 4 * (sizeof(wen_link) + sizeof(wen_link *)));
+
+    memset(&fio[0], 0, sizeof(fio[0]));
+    a = wen_link_pool_acquire(&pool, io0);
+    ASSERT(a && !wen_link_has_buffers(a));
+    wen_link_attach_codec(a, &framed_codec, a);
+    while (!wen_poll(a, &ev));
+    ASSERT(ev.type == WEN_EV_OPEN);
+    ASSERT(wen_buffer_pool_available(&buffers) == 0);
+
+    wen_link_pool_release(&pool, a);
+    ASSERT(wen_buffer_pool_available(&buffers) == 1);
+    wen_link_pool_free(&pool);
+    wen_buffer_pool_free(&buffers);
+}
+#endif // TEST
@@ -0,0 +1,58 @@
+#ifdef TEST
+static void test_link_table(void)
+{
+    static block_io bio[3];
+    wen_link links[3];
+    wen_link *found[4];
+    wen_link_table table;
+    wen_event ev;
+
+    memset(bio, 0, sizeof(bio));
+    ASSERT(wen_link_table_init(&table, 2) == WEN_OK);
+
+    for (int i = 0; i < 3; i++) {
+        wen_io io = {.user=&bio[i], .read=block_read, .write=block_write};
+        ASSERT(wen_link_init(&links[i], io) == WEN_OK);
+        wen_link_attach_codec(&links[i], &vec_codec, &links[i]);
+    }
+    ASSERT(wen_link_table_add(&table, &links[0]) == WEN_OK);
+    ASSERT(wen_link_table_add(&table, &links[1]) == WEN_OK);
+    ASSERT(wen_link_table_add(&table, &links[2]) == WEN_ERR_OVERFLOW);
+    ASSERT(table.state[0] == WEN_LINK_HANDSHAKE);
+
+    // Polling and sending keep the mirrored state current.
+    while (!wen_poll(&links[1], &ev));
+    ASSERT(ev.type == WEN_EV_OPEN);
+    ASSERT(table.state[1] == WEN_LINK_OPEN);
+
+    bio[1].write_blocked = 1;
+    ASSERT(wen_send(&links[1], WEN_WS_OP_TEXT, "hi", 2) == WEN_OK);
+    ASSERT(table.tx_len[1] == 4);
+    ASSERT(wen_link_table_find(&table, WEN_LINK_F_TX_PENDING, found, 4) == 1);
+    ASSERT(found[0] == &links[1]);
+
+    bio[1].read_blocked = 1;
+    ASSERT(!wen_poll(&links[1], &ev));
+    ASSERT(wen_link_table_find(&table, WEN_LINK_F_TX_BLOCKED, found, 4) == 1);
+
+    // Deadline sweeps only look at the deadline array.
+    wen_link_table_set_deadline(&table, &links[0], 100);
+    wen_link_table_set_deadline(&table, &links[1], 200);
+    ASSERT(wen_link_table_expired(&table, 50, found, 4) == 0);
+    ASSERT(wen_link_table_expired(&table, 150, found, 4) == 1);
+    ASSERT(found[0] == &links[0]);
+
+    // Removing a link moves the last entry into its slot.
+    wen_link_table_remove(&table, &links[0]);
+    ASSERT(table.count == 1);
+    ASSERT(links[1].table_index == 0);
+    ASSERT(table.links[0] == &links[1] && table.deadline[0] == 200);
+    ASSERT(table.tx_len[0] == 4);
+    ASSERT(wen_link_table_add(&table, &links[2]) == WEN_OK);
+    ASSERT(links[2].table_index == 1 && table.deadline[1] == 0);
+
+    wen_link_table_free(&table);
+    ASSERT(links[1].table == NULL);
+    for (int i = 0; i < 3; i++) wen_link_deinit(&links[i]);
+}
+#endif // TEST
@@ -0,0 +1,116 @@
+#ifdef TEST
+#if defined(__linux__)
+#    include <errno.h>
+#    include <sys/socket.h>
+
+static long fd_result(long n)
+{
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return WEN_IO_WOULD_BLOCK;
+    return n;
+}
+
+static long fd_read(void *user, void *buf, unsigned long len)
+{
+    return fd_result(read(*(int *)user, buf, len));
+}
+
+static long fd_write(void *user, const void *buf, unsigned long len)
+{
+    return fd_result(write(*(int *)user, buf, len));
+}
+
+// Runs the loop until [type] is delivered, returning its index in [out] or -1.
+static int loop_until(wen_loop *loop, wen_loop_event *out, unsigned cap, wen_event_type type)
+{
+    for (int tries = 0; tries < 8; tries++) {
+        unsigned n = wen_loop_run(loop, out, cap, 1000);
+        for (unsigned i = 0; i < n; i++)
+            if (out[i].ev.type == type) return (int)i;
+    }
+    return -1;
+}
+#endif
+
+static void test_loop(void)
+{
+    wen_loop loop;
+    wen_result r = wen_loop_init(&loop);
+    if (r == WEN_ERR_UNSUPPORTED) return;
+    ASSERT(r == WEN_OK);
+
+#if defined(__linux__)
+    int sv[3][2];
+    wen_link links[2];
+    wen_loop_event out[8];
+    unsigned char buf[16];
+
+    for (int i = 0; i < 3; i++)
+        ASSERT(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv[i]) == 0);
+
+    for (int i = 0; i < 2; i++) {
+        wen_io io = {.user=&sv[i][0], .read=fd_read, .write=fd_write};
+        ASSERT(wen_link_init(&links[i], io) == WEN_OK);
+        wen_link_attach_codec(&links[i], &framed_codec, &links[i]);
+        ASSERT(wen_loop_add(&loop, &links[i], sv[i][0]) == WEN_OK);
+    }
+    ASSERT(wen_loop_add(&loop, &links[0], sv[0][0]) == WEN_ERR_STATE);
+    ASSERT(links[0].drain_reads == WEN_LOOP_DRAIN_READS);
+
+    wen_loop_watch watch = {.fd=sv[2][0], .user=&sv[2]};
+    ASSERT(wen_loop_add_watch(&loop, &watch) == WEN_OK);
+
+    // Idle links are polled once after registration and then left alone.
+    ASSERT(wen_loop_run(&loop, out, 8, 0) == 0);
+    ASSERT(loop.ready_count == 0);
+    ASSERT(wen_loop_run(&loop, out, 8, 0) == 0);
+
+    // Only the link whose socket became readable reports anything.
+    ASSERT(write(sv[1][1], "x", 1) == 1);
+    int i = loop_until(&loop, out, 8, WEN_EV_OPEN);
+    ASSERT(i >= 0);
+    ASSERT(out[i].link == &links[1]);
+    ASSERT(links[0].state == WEN_LINK_HANDSHAKE);
+
+    ASSERT(write(sv[1][1], "\x81\x02hi", 4) == 4);
+    i = loop_until(&loop, out, 8, WEN_EV_SLICE);
+    ASSERT(i >= 0);
+    ASSERT(out[i].link == &links[1]);
+    ASSERT(out[i].ev.as.slice.len == 4);
+    wen_release(&links[1], out[i].ev.as.slice);
+
+    // Output queued by the application is flushed on the next run.
+    ASSERT(wen_send(&links[1], WEN_WS_OP_TEXT, "yo", 2) == WEN_OK);
+    ASSERT(loop.ready_count == 1);
+    wen_loop_run(&loop, out, 8, 0);
+    ASSERT(links[1].tx_len == 0);
+    ASSERT(read(sv[1][1], buf, sizeof(buf)) == 4);
+    ASSERT(memcmp(buf + 2, "yo", 2) == 0);
+
+    // Watched descriptors come back without a link.
+    ASSERT(write(sv[2][1], "a", 1) == 1);
+    ASSERT(wen_loop_run(&loop, out, 8, 1000) == 1);
+    ASSERT(out[0].link == NULL && out[0].watch == &watch);
+    ASSERT(read(sv[2][0], buf, 1) == 1);
+
+    // A hang-up closes the link and takes it out of the loop.
+    close(sv[1][1]);
+    i = loop_until(&loop, out, 8, WEN_EV_CLOSE);
+    ASSERT(i >= 0);
+    ASSERT(out[i].link == &links[1]);
+    ASSERT(links[1].loop == NULL);
+    ASSERT(loop.count == 1);
+
+    wen_loop_remove(&loop, &links[0]);
+    wen_loop_remove_watch(&loop, &watch);
+    ASSERT(loop.count == 0);
+    wen_loop_free(&loop);
+    wen_link_deinit(&links[0]);
+
+    close(sv[0][0]);
+    close(sv[0][1]);
+    close(sv[1][0]);
+    close(sv[2][0]);
+    close(sv[2][1]);
+#endif
+}
+#endif
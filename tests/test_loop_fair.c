@@ -0,0 +1,88 @@
+#ifdef TEST
+static void test_loop_fair(void)
+{
+    wen_loop loop;
+    wen_result r = wen_loop_init(&loop);
+    if (r == WEN_ERR_UNSUPPORTED) return;
+    ASSERT(r == WEN_OK);
+    ASSERT(loop.quantum == WEN_LOOP_QUANTUM);
+
+#if defined(__linux__)
+    int sv[2][2];
+    wen_link links[2];
+    wen_loop_event out[64];
+    unsigned char frames[60 * 12];
+
+    for (int i = 0; i < 2; i++) {
+        ASSERT(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv[i]) == 0);
+        wen_io io = {.user=&sv[i][0], .read=fd_read, .write=fd_write};
+        ASSERT(wen_link_init(&links[i], io) == WEN_OK);
+        wen_link_attach_codec(&links[i], &framed_codec, &links[i]);
+        wen_link_set_slice_limit(&links[i], WEN_MAX_OUTSTANDING);
+        ASSERT(wen_loop_add(&loop, &links[i], sv[i][0]) == WEN_OK);
+        ASSERT(write(sv[i][1], "x", 1) == 1);
+    }
+    for (int opened = 0, tries = 0; opened < 2 && tries < 8; tries++) {
+        unsigned n = wen_loop_run(&loop, out, 64, 1000);
+        for (unsigned i = 0; i < n; i++) opened += out[i].ev.type == WEN_EV_OPEN;
+    }
+
+    // Four events and 30 bytes per round; every frame is 12 bytes.
+    wen_loop_set_quantum(&loop, 4, 30);
+    for (int i = 0; i < 60; i++) memcpy(frames + i * 12, "\x81\x0a" "0123456789", 12);
+    ASSERT(write(sv[0][1], frames, sizeof(frames)) == (long)sizeof(frames));
+    ASSERT(write(sv[1][1], "\x81\x02hi", 4) == 4);
+
+    // The quiet link is served in the first round despite the flood.
+    int got[2] = {0, 0};
+    unsigned n = wen_loop_run(&loop, out, 64, 1000);
+    for (unsigned i = 0; i < n; i++) {
+        if (out[i].ev.type != WEN_EV_SLICE) continue;
+        got[out[i].link == &links[1]]++;
+        wen_release(out[i].link, out[i].ev.as.slice);
+    }
+    ASSERT(got[1] == 1);
+    ASSERT(got[0] > 0 && got[0] <= 4);
+
+    // Overrunning the byte budget costs later rounds, so the heavy link
+    // averages its quantum.
+    int rounds = 1, skipped = 0;
+    while (got[0] < 60 && rounds < 200) {
+        int before = got[0];
+        n = wen_loop_run(&loop, out, 64, 0);
+        for (unsigned i = 0; i < n; i++) {
+            if (out[i].ev.type != WEN_EV_SLICE) continue;
+            got[out[i].link == &links[1]]++;
+            wen_release(out[i].link, out[i].ev.as.slice);
+        }
+        ASSERT(got[0] - before <= 4);
+        if (got[0] == before) skipped++;
+        rounds++;
+        ASSERT(got[0] * 12 <= rounds * 30 + 48);
+    }
+    ASSERT(got[0] == 60);
+    ASSERT(skipped > 0);
+
+    // Once idle, the link starts over without debt.
+    ASSERT(wen_loop_run(&loop, out, 64, 0) == 0);
+    ASSERT(links[0].loop_deficit == 0);
+
+    // Rounds spent on other events do not bank byte credit.
+    wen_event tick = {.type = WEN_EV_TIMEOUT};
+    for (int i = 0; i < 12; i++) ASSERT(wen_evq_push(&links[1].evq, &tick));
+    wen__loop_queue(&loop, &links[1]);
+    for (int i = 0; i < 3; i++) {
+        ASSERT(wen_loop_run(&loop, out, 64, 0) == 4);
+        ASSERT(links[1].loop_deficit <= 30);
+    }
+
+    for (int i = 0; i < 2; i++) {
+        wen_loop_remove(&loop, &links[i]);
+        wen_link_deinit(&links[i]);
+        close(sv[i][0]);
+        close(sv[i][1]);
+    }
+    wen_loop_free(&loop);
+#endif
+}
+#endif
@@ -0,0 +1,54 @@
+#ifdef TEST
+static void test_loop_spin(void)
+{
+    wen_loop loop;
+    wen_result r = wen_loop_init(&loop);
+    if (r == WEN_ERR_UNSUPPORTED) return;
+    ASSERT(r == WEN_OK);
+
+#if defined(__linux__)
+    int sv[2];
+    wen_link link;
+    wen_loop_event out[8];
+
+    ASSERT(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv) == 0);
+    wen_io io = {.user=&sv[0], .read=fd_read, .write=fd_write};
+    ASSERT(wen_link_init(&link, io) == WEN_OK);
+    wen_link_attach_codec(&link, &framed_codec, &link);
+    ASSERT(wen_loop_add(&loop, &link, sv[0]) == WEN_OK);
+    wen_loop_run(&loop, out, 8, 0);
+
+    // Nothing happened yet, so the first wait sleeps.
+    wen_loop_set_spin(&loop, 50000);
+    ASSERT(wen_loop_run(&loop, out, 8, 5) == 0);
+    ASSERT(loop.stats.spin_us == 0);
+    ASSERT(loop.stats.sleeps == 1);
+
+    ASSERT(write(sv[1], "x", 1) == 1);
+    ASSERT(loop_until(&loop, out, 8, WEN_EV_OPEN) >= 0);
+    ASSERT(loop.last_active != 0);
+
+    // Within the window, data is found by spinning.
+    unsigned long sleeps = loop.stats.sleeps;
+    ASSERT(write(sv[1], "\x81\x02hi", 4) == 4);
+    int i = loop_until(&loop, out, 8, WEN_EV_SLICE);
+    ASSERT(i >= 0);
+    wen_release(&link, out[i].ev.as.slice);
+    ASSERT(loop.stats.spin_wakeups >= 1);
+    ASSERT(loop.stats.sleeps == sleeps);
+
+    // Once the window closes without activity, the rest of the wait is slept.
+    unsigned long long spun = loop.stats.spin_us;
+    ASSERT(wen_loop_run(&loop, out, 8, 200) == 0);
+    ASSERT(loop.stats.spin_us > spun);
+    ASSERT(loop.stats.sleeps == sleeps + 1);
+    ASSERT(loop.stats.sleep_us > 0);
+
+    wen_loop_remove(&loop, &link);
+    wen_link_deinit(&link);
+    wen_loop_free(&loop);
+    close(sv[0]);
+    close(sv[1]);
+#endif
+}
+#endif
@@ -0,0 +1,42 @@
+#ifdef TEST
+static void test_poll_batch(void)
+{
+    fake_io fio = {0};
+    wen_link link;
+    wen_event out[8];
+
+    wen_io io = {.user=&fio, .read=fake_read, .write=fake_write};
+    ASSERT(wen_link_init(&link, io) == WEN_OK);
+    wen_link_attach_codec(&link, &framed_codec, &link);
+    ASSERT(wen_link_set_slice_limit(&link, 4) == WEN_OK);
+
+    ASSERT(wen_poll_batch(&link, out, 8) == 1);
+    ASSERT(out[0].type == WEN_EV_OPEN);
+
+    fake_feed(&fio, WEN_WS_OP_TEXT, (unsigned char *)"one", 3);
+    fake_feed(&fio, WEN_WS_OP_TEXT, (unsigned char *)"two", 3);
+    fake_feed(&fio, WEN_WS_OP_TEXT, (unsigned char *)"three", 5);
+
+    // One call reads once and decodes as many frames as fit.
+    ASSERT(wen_poll_batch(&link, out, 2) == 2);
+    ASSERT(out[0].type == WEN_EV_SLICE && out[1].type == WEN_EV_SLICE);
+    ASSERT(memcmp((const char *)out[0].as.slice.data + 2, "one", 3) == 0);
+    ASSERT(memcmp((const char *)out[1].as.slice.data + 2, "two", 3) == 0);
+    ASSERT(link.rx_len == 7);
+
+    // The rest is already buffered and comes out without another read.
+    unsigned long in_pos = fio.in_pos;
+    ASSERT(wen_poll_batch(&link, out + 2, 6) == 1);
+    ASSERT(fio.in_pos == in_pos);
+    ASSERT(memcmp((const char *)out[2].as.slice.data + 2, "three", 5) == 0);
+    ASSERT(wen_link_slices_outstanding(&link) == 3);
+
+    for (int i = 0; i < 3; i++) wen_release(&link, out[i].as.slice);
+
+    // The close queued by the read comes out in the same batch.
+    fake_close(&fio);
+    ASSERT(wen_poll_batch(&link, out, 8) == 1);
+    ASSERT(out[0].type == WEN_EV_CLOSE);
+    ASSERT(wen_poll_batch(&link, out, 8) == 0);
+}
+#endif // TEST
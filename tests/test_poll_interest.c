@@ -0,0 +1,85 @@
+#ifdef TEST
+static void test_poll_interest(void)
+{
+    static wen_timers timers;
+    block_io bio = {0};
+    wen_link link;
+    wen_event ev;
+    unsigned interest;
+    long next_ms;
+
+    wen_io io = {.user=&bio, .read=block_read, .write=block_write};
+    ASSERT(wen_link_init(&link, io) == WEN_OK);
+    wen_link_attach_codec(&link, &framed_codec, &link);
+    wen_link_set_slice_limit(&link, 4);
+
+    // An idle link only waits for input and has no deadline.
+    bio.read_blocked = 1;
+    ASSERT(!wen_poll_interest(&link, &ev, &interest, &next_ms));
+    ASSERT(interest == WEN_WANT_READ);
+    ASSERT(next_ms == -1);
+
+    // Buffered frames and queued events ask for another poll right away,
+    // until everything that was read has been handed out.
+    bio.read_blocked = 0;
+    while (!wen_poll(&link, &ev));
+    ASSERT(ev.type == WEN_EV_OPEN);
+    fake_feed(&bio.base, WEN_WS_OP_TEXT, (unsigned char *)"a", 1);
+    fake_feed(&bio.base, WEN_WS_OP_TEXT, (unsigned char *)"b", 1);
+
+    int slices = 0, polls = 0;
+    do {
+        if (wen_poll_interest(&link, &ev, &interest, NULL) && ev.type == WEN_EV_SLICE) {
+            slices++;
+            wen_release(&link, ev.as.slice);
+        }
+        if (polls++ == 0) {
+            ASSERT(interest & WEN_HAS_EVENTS);
+            bio.read_blocked = 1;
+        }
+    } while ((interest & WEN_HAS_EVENTS) && polls < 8);
+    ASSERT(slices == 2);
+    ASSERT(interest == WEN_WANT_READ);
+
+    // Writability only matters while output is queued.
+    bio.read_blocked = 1;
+    bio.write_blocked = 1;
+    ASSERT(wen_send(&link, WEN_WS_OP_TEXT, "out", 3) == WEN_OK);
+    ASSERT(!wen_poll_interest(&link, &ev, &interest, NULL));
+    ASSERT(interest == (WEN_WANT_READ | WEN_WANT_WRITE));
+    bio.write_blocked = 0;
+    ASSERT(!wen_poll_interest(&link, &ev, &interest, NULL));
+    ASSERT(interest == WEN_WANT_READ);
+
+    // The nearest deadline comes along with the interest.
+    wen_timers_init(&timers, 10, 1000);
+    wen_timers_add(&timers, &link);
+    wen_link_set_timeouts(&link, 0, 500, 200);
+    ASSERT(!wen_poll_interest(&link, &ev, &interest, &next_ms));
+    ASSERT(next_ms == 200);
+    wen_timers_advance(&timers, 1150);
+    ASSERT(wen_link_next_deadline(&link) == 50);
+
+    wen_link_deinit(&link);
+    ASSERT(wen_link_next_deadline(&link) == -1);
+
+    // A pooled link that handed its idle buffers back still waits for input.
+    wen_buffer_pool pool;
+    wen_link_config sizes = {.rx_size=512, .tx_size=512};
+    ASSERT(wen_buffer_pool_init(&pool, &sizes, 1) == WEN_OK);
+    wen_link_config cfg = {.pool=&pool};
+    memset(&bio, 0, sizeof(bio));
+    ASSERT(wen_link_init_ex(&link, io, &cfg) == WEN_OK);
+    wen_link_attach_codec(&link, &framed_codec, &link);
+    while (!wen_poll(&link, &ev));
+    ASSERT(ev.type == WEN_EV_OPEN);
+
+    bio.read_blocked = 1;
+    ASSERT(!wen_poll_interest(&link, &ev, &interest, NULL));
+    ASSERT(!wen_link_has_buffers(&link));
+    ASSERT(interest == WEN_WANT_READ);
+
+    wen_link_deinit(&link);
+    wen_buffer_pool_free(&pool);
+}
+#endif
@@ -0,0 +1,84 @@
+#ifdef TEST
+typedef struct {
+    unsigned long total;
+    unsigned long pos;
+    int kicked;
+    int reads;
+} stream_io;
+
+// Produces an endless run of 5 byte frames, always filling the whole buffer.
+static long stream_read(void *user, void *buf, unsigned long len)
+{
+    stream_io *io = user;
+    unsigned char *b = buf;
+
+    if (!io->kicked) {
+        io->kicked = 1;
+        b[0] = 0;
+        return 1;
+    }
+
+    unsigned long n = WEN_MIN(len, io->total - io->pos);
+    for (unsigned long i = 0; i < n; i++) {
+        unsigned long k = (io->pos + i) % 5;
+        b[i] = k == 0 ? 0x81 : k == 1 ? 3 : (unsigned char)('a' + k - 2);
+    }
+    io->pos += n;
+    io->reads++;
+    return (long)n;
+}
+
+static void test_read_drain(void)
+{
+    static stream_io sio;
+    wen_link link;
+    wen_event ev;
+
+    memset(&sio, 0, sizeof(sio));
+    sio.total = 4 * WEN_RX_BUFFER;
+
+    wen_io io = {.user=&sio, .read=stream_read, .write=fake_write};
+    ASSERT(wen_link_init(&link, io) == WEN_OK);
+    wen_link_attach_codec(&link, &framed_codec, &link);
+    ASSERT(wen_link_set_slice_limit(&link, 8) == WEN_OK);
+
+    while (!wen_poll(&link, &ev));
+    ASSERT(ev.type == WEN_EV_OPEN);
+
+    // Default: one read per poll.
+    ASSERT(!wen_poll(&link, &ev));
+    ASSERT(sio.reads == 1);
+    ASSERT(wen_evq_pop(&link.evq, &ev));
+    wen_release(&link, ev.as.slice);
+    link.rx_len = link.rx_off = 0;
+    sio.pos += (5 - sio.pos % 5) % 5;
+
+    // Drain mode keeps reading while reads come back full, decoding into the
+    // queue to make room, until the read budget is spent.
+    wen_link_set_drain(&link, 2, 0);
+    sio.reads = 0;
+    ASSERT(!wen_poll(&link, &ev));
+    ASSERT(sio.reads == 2);
+    ASSERT(!wen_link_rx_drained(&link));
+    ASSERT(wen_link_slices_outstanding(&link) == 8);
+    ASSERT(link.rx_len == WEN_RX_BUFFER);
+
+    int slices = 0;
+    while (wen_evq_pop(&link.evq, &ev)) {
+        ASSERT(ev.type == WEN_EV_SLICE);
+        ASSERT(memcmp((const char *)ev.as.slice.data + 2, "abc", 3) == 0);
+        wen_release(&link, ev.as.slice);
+        slices++;
+    }
+    ASSERT(slices == 8);
+
+    // A short read means the transport ran dry.
+    sio.pos += (5 - sio.pos % 5) % 5;
+    sio.total = sio.pos + 10;
+    link.rx_len = link.rx_off = 0;
+    sio.reads = 0;
+    (void)wen_poll(&link, &ev);
+    ASSERT(sio.reads == 1);
+    ASSERT(wen_link_rx_drained(&link));
+}
+#endif // TEST
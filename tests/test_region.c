@@ -0,0 +1,32 @@
+#ifdef TEST
+static void test_region(void)
+{
+    wen_region region;
+    wen_link_pool pool;
+    fake_io fio = {0};
+
+    wen_result r = wen_region_map(&region, 1024 * 1024, WEN_REGION_HUGE_PAGES | WEN_REGION_PREFAULT);
+    if (r == WEN_ERR_UNSUPPORTED) return;
+    ASSERT(r == WEN_OK);
+    ASSERT(region.base != NULL && region.size >= 1024 * 1024);
+    if (region.huge) ASSERT(region.size % WEN_HUGE_PAGE_SIZE == 0);
+
+    // Carve a whole link pool, buffers and arenas included, out of the region.
+    wen_link_config cfg = {.rx_size=1024, .tx_size=1024};
+    unsigned long size = wen_link_pool_mem_size(&cfg, 16);
+    void *mem = wen_region_alloc(&region, size);
+    ASSERT(mem != NULL);
+    ASSERT(wen_link_pool_bind(&pool, &cfg, 16, mem, size) == WEN_OK);
+
+    wen_io io = {.user=&fio, .read=fake_read, .write=fake_write};
+    wen_link *link = wen_link_pool_acquire(&pool, io);
+    ASSERT(link != NULL);
+    ASSERT(link->rx_buf >= region.base && link->arena.base + link->arena.capacity <= region.base + region.used);
+
+    ASSERT(wen_region_alloc(&region, region.size) == NULL);
+
+    wen_link_pool_free(&pool);
+    wen_region_unmap(&region);
+    ASSERT(region.base == NULL);
+}
+#endif // TEST
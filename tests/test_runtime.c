@@ -0,0 +1,121 @@
+#ifdef TEST
+#if defined(__linux__)
+#    include <arpa/inet.h>
+#    include <netinet/in.h>
+
+#    define RT_CLIENTS 8
+
+static wen_link rt_links[RT_CLIENTS];
+static int rt_fds[RT_CLIENTS];
+static int rt_accepted, rt_opened, rt_closed;
+static int rt_per_shard[2];
+static int rt_pinned;
+
+static void rt_start(wen_shard *shard)
+{
+#ifdef WEN__PIN
+    // The thread runs on the CPU it reports before anything else happens.
+    if (shard->cpu >= 0 && sched_getcpu() == shard->cpu) __atomic_fetch_add(&rt_pinned, 1, __ATOMIC_ACQ_REL);
+#else
+    WEN_UNUSED(shard);
+#endif
+}
+
+static void rt_accept(wen_shard *shard, int fd)
+{
+    int i = __atomic_fetch_add(&rt_accepted, 1, __ATOMIC_ACQ_REL);
+    if (i >= RT_CLIENTS) {
+        close(fd);
+        return;
+    }
+
+    rt_fds[i] = fd;
+    wen_io io = {.user=&rt_fds[i], .read=fd_read, .write=fd_write};
+    wen_link_init(&rt_links[i], io);
+    wen_link_attach_codec(&rt_links[i], &framed_codec, &rt_links[i]);
+    rt_links[i].user_data = shard;
+    wen_loop_add(&shard->loop, &rt_links[i], fd);
+    __atomic_fetch_add(&rt_per_shard[shard->index], 1, __ATOMIC_ACQ_REL);
+}
+
+static void rt_event(wen_shard *shard, wen_loop_event *ev)
+{
+    // Links only ever show up on the shard that accepted them.
+    if (ev->link->user_data != shard) return;
+
+    if (ev->ev.type == WEN_EV_OPEN) __atomic_fetch_add(&rt_opened, 1, __ATOMIC_ACQ_REL);
+    if (ev->ev.type == WEN_EV_CLOSE) {
+        close(*(int *)ev->link->io.user);
+        __atomic_fetch_add(&rt_closed, 1, __ATOMIC_ACQ_REL);
+    }
+}
+
+static bool rt_wait(int *counter, int value)
+{
+    for (int i = 0; i < 2000; i++) {
+        if (__atomic_load_n(counter, __ATOMIC_ACQUIRE) >= value) return true;
+        struct timespec ts = {0, 1000000};
+        nanosleep(&ts, NULL);
+    }
+    return false;
+}
+#endif
+
+static void test_runtime(void)
+{
+#if defined(__linux__)
+    wen_runtime rt;
+    wen_runtime_config cfg = {
+        .shards = 2,
+        .host = "127.0.0.1",
+        .on_accept = rt_accept,
+        .on_event = rt_event,
+    };
+
+#ifndef WEN__PIN
+    // Pinning is refused rather than silently skipped where it is unavailable.
+    cfg.pin = true;
+    ASSERT(wen_runtime_start(&rt, &cfg) == WEN_ERR_UNSUPPORTED);
+    cfg.pin = false;
+#else
+    // Shards are pinned to CPUs the process is allowed on.
+    cfg.pin = true;
+    cfg.on_start = rt_start;
+    ASSERT(wen_runtime_start(&rt, &cfg) == WEN_OK);
+    ASSERT(rt_wait(&rt_pinned, 2));
+    wen_runtime_stop(&rt);
+    cfg.pin = false;
+    cfg.on_start = NULL;
+#endif
+
+    wen_result r = wen_runtime_start(&rt, &cfg);
+    if (r == WEN_ERR_UNSUPPORTED) return;
+    ASSERT(r == WEN_OK);
+    ASSERT(rt.count == 2);
+    ASSERT(rt.port != 0);
+
+    // Every shard listens on the same port.
+    int clients[RT_CLIENTS];
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(rt.port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    for (int i = 0; i < RT_CLIENTS; i++) {
+        clients[i] = socket(AF_INET, SOCK_STREAM, 0);
+        ASSERT(clients[i] >= 0);
+        ASSERT(connect(clients[i], (struct sockaddr *)&addr, sizeof(addr)) == 0);
+        ASSERT(write(clients[i], "x", 1) == 1);
+    }
+    ASSERT(rt_wait(&rt_opened, RT_CLIENTS));
+    ASSERT(rt_per_shard[0] + rt_per_shard[1] == RT_CLIENTS);
+
+    for (int i = 0; i < RT_CLIENTS; i++) close(clients[i]);
+    ASSERT(rt_wait(&rt_closed, RT_CLIENTS));
+
+    wen_runtime_stop(&rt);
+    ASSERT(rt.shards == NULL);
+#endif
+}
+#endif
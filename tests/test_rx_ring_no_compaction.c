@@ -0,0 +1,99 @@
+#ifdef TEST
+static wen_result framed_decode(void *state, const void *data, unsigned long len)
+{
+    wen_link *link = state;
+    const unsigned char *b = data;
+
+    if (len < 2) return WEN_OK;
+    link->frame_len = 2 + (unsigned long)b[1];
+    return WEN_OK;
+}
+
+static const wen_codec framed_codec = {
+    .name = "framed",
+    .handshake = fake_handshake,
+    .decode = framed_decode,
+    .encode = fake_encode
+};
+
+static void test_rx_ring_no_compaction(void)
+{
+    fake_io fio = {0};
+    wen_link link;
+    wen_event ev;
+
+    wen_io io = {.user=&fio, .read=fake_read, .write=fake_write};
+    ASSERT(wen_link_init(&link, io) == WEN_OK);
+    wen_link_attach_codec(&link, &framed_codec, &link);
+
+    while (!wen_poll(&link, &ev));
+    ASSERT(ev.type == WEN_EV_OPEN);
+
+    fake_feed(&fio, WEN_WS_OP_TEXT, (unsigned char *)"one", 3);
+    fake_feed(&fio, WEN_WS_OP_TEXT, (unsigned char *)"two", 3);
+    while (!wen_poll(&link, &ev));
+    ASSERT(ev.type == WEN_EV_SLICE);
+    ASSERT(ev.as.slice.len == 5);
+    ASSERT(memcmp((const char *)ev.as.slice.data + 2, "one", 3) == 0);
+
+    // The first frame is retired by advancing the cursor, the second one stays in place.
+    ASSERT(link.rx_off == 5);
+    ASSERT(link.rx_len == 5);
+    ASSERT(memcmp(link.rx_buf + 5 + 2, "two", 3) == 0);
+    wen_release(&link, ev.as.slice);
+
+    ASSERT(!wen__poll_decode(&link, &ev));
+    ASSERT(wen_evq_pop(&link.evq, &ev));
+    ASSERT(ev.type == WEN_EV_SLICE);
+    ASSERT(memcmp((const char *)ev.as.slice.data + 2, "two", 3) == 0);
+    wen_release(&link, ev.as.slice);
+
+    // Drained ring rewinds to the start.
+    ASSERT(link.rx_off == 0 && link.rx_len == 0);
+
+    // A frame whose header was decoded before the ring wrapped is delivered
+    // in two slices, flagged as the two halves of one frame.
+    link.rx_off = WEN_RX_BUFFER - 4;
+    fake_feed(&fio, WEN_WS_OP_TEXT, (unsigned char *)"three", 5);
+    ASSERT(wen__poll_read_rx(&link, &ev) == (unsigned)-1);
+    ASSERT(link.rx_len == 4);
+    ASSERT(!wen__poll_decode(&link, &ev));
+    ASSERT(wen_evq_pop(&link.evq, &ev));
+    ASSERT(ev.as.slice.len == 4);
+    ASSERT(ev.as.slice.flags == WEN_SLICE_BEGIN);
+    ASSERT(memcmp((const char *)ev.as.slice.data + 2, "th", 2) == 0);
+    wen_release(&link, ev.as.slice);
+
+    ASSERT(wen__poll_read_rx(&link, &ev) == (unsigned)-1);
+    ASSERT(link.rx_len == 3);
+    ASSERT(!wen__poll_decode(&link, &ev));
+    ASSERT(wen_evq_pop(&link.evq, &ev));
+    ASSERT(ev.as.slice.len == 3);
+    ASSERT(ev.as.slice.flags == WEN_SLICE_END);
+    ASSERT(memcmp(ev.as.slice.data, "ree", 3) == 0);
+    wen_release(&link, ev.as.slice);
+    ASSERT(link.frame_len == 0 && link.rx_len == 0);
+
+    // A header straddling the end of rx_buf is straightened out before
+    // decoding, so frames stay in sync.
+    link.rx_off = WEN_RX_BUFFER - 1;
+    fake_feed(&fio, WEN_WS_OP_TEXT, (unsigned char *)"xyz", 3);
+    fake_feed(&fio, WEN_WS_OP_TEXT, (unsigned char *)"end", 3);
+    ASSERT(wen__poll_read_rx(&link, &ev) == (unsigned)-1);
+    ASSERT(wen__poll_read_rx(&link, &ev) == (unsigned)-1);
+    ASSERT(link.rx_len == 10);
+
+    const char *want[2] = {"\x81\x03" "xyz", "\x81\x03" "end"};
+    for (int i = 0; i < 2; i++) {
+        ASSERT(!wen__poll_decode(&link, &ev));
+        ASSERT(wen_evq_pop(&link.evq, &ev));
+        ASSERT(ev.as.slice.len == 5);
+        ASSERT(ev.as.slice.flags == (WEN_SLICE_BEGIN | WEN_SLICE_END));
+        ASSERT(memcmp(ev.as.slice.data, want[i], 5) == 0);
+        wen_release(&link, ev.as.slice);
+    }
+
+    ASSERT(link.frame_len == 0);
+    ASSERT(link.rx_len == 0);
+}
+#endif // TEST
@@ -0,0 +1,84 @@
+#ifdef TEST
+static wen_result ref_encode_header(void *codec_state, unsigned opcode, unsigned long len,
+                                    void *out, unsigned long out_cap, unsigned long *out_len)
+{
+    WEN_UNUSED(codec_state);
+    if (out_cap < 2) return WEN_ERR_OVERFLOW;
+
+    unsigned char *b = out;
+    b[0] = 0x80 | (unsigned char)opcode;
+    b[1] = (unsigned char)(len & 0xff);
+    *out_len = 2;
+    return WEN_OK;
+}
+
+static const wen_codec ref_codec = {
+    .name = "ref",
+    .handshake = fake_handshake,
+    .decode = fake_decode,
+    .encode = capped_encode,
+    .encode_header = ref_encode_header
+};
+
+static void test_send_ref_zero_copy(void)
+{
+    static vec_io vio;
+    static unsigned char big[2 * WEN_TX_BUFFER + 100];
+    wen_link link;
+    wen_event ev;
+
+    memset(&vio, 0, sizeof(vio));
+    memset(big, 'z', sizeof(big));
+    vio.base.max_write = 4096;
+
+    wen_io io = {.user=&vio, .read=slow_read, .write=slow_write};
+    ASSERT(wen_link_init(&link, io) == WEN_OK);
+    wen_link_attach_codec(&link, &ref_codec, NULL);
+
+    while (!wen_poll(&link, &ev));
+    ASSERT(ev.type == WEN_EV_OPEN);
+
+    // Payloads larger than tx_buf are fine, only their header is buffered.
+    ASSERT(wen_send(&link, WEN_WS_OP_TEXT, "hi", 2) == WEN_OK);
+    ASSERT(wen_send_ref(&link, WEN_WS_OP_BINARY, big, sizeof(big), &link) == WEN_OK);
+    ASSERT(wen_send(&link, WEN_WS_OP_TEXT, "bye", 3) == WEN_OK);
+    ASSERT(link.tx_len == 4 + 2 + 5);
+
+    int flushes = 0;
+    while (link.tx_len || link.tx_ref_count) {
+        ASSERT(!wen__poll_flush_tx(&link, &ev));
+        flushes++;
+    }
+    ASSERT(flushes > 2);
+
+    ASSERT(wen_evq_pop(&link.evq, &ev));
+    ASSERT(ev.type == WEN_EV_SENT);
+    ASSERT(ev.as.sent.data == big);
+    ASSERT(ev.as.sent.len == sizeof(big));
+    ASSERT(ev.as.sent.user == &link);
+    ASSERT(!wen_evq_pop(&link.evq, &ev));
+
+    // Wire order is header, payload, then whatever was queued after it.
+    ASSERT(vio.base.out_len == 4 + 2 + sizeof(big) + 5);
+    ASSERT(memcmp(vio.base.out + 2, "hi", 2) == 0);
+    ASSERT(vio.base.out[5] == (sizeof(big) & 0xff));
+    ASSERT(memcmp(vio.base.out + 6, big, sizeof(big)) == 0);
+    ASSERT(memcmp(vio.base.out + 6 + sizeof(big) + 2, "bye", 3) == 0);
+
+    // With writev, backlog and payloads go out in a single call.
+    memset(&vio, 0, sizeof(vio));
+    vio.base.max_write = sizeof(vio.base.out);
+    link.io.writev = vec_writev;
+
+    ASSERT(wen_send_ref(&link, WEN_WS_OP_BINARY, big, 100, NULL) == WEN_OK);
+    ASSERT(wen_send_ref(&link, WEN_WS_OP_BINARY, big + 100, 200, NULL) == WEN_OK);
+    ASSERT(wen_send(&link, WEN_WS_OP_TEXT, "end", 3) == WEN_OK);
+    ASSERT(!wen__poll_flush_tx(&link, &ev));
+    ASSERT(vio.writev_calls == 1);
+    ASSERT(vio.base.out_len == 2 + 100 + 2 + 200 + 5);
+    ASSERT(link.tx_len == 0 && link.tx_ref_count == 0);
+
+    ASSERT(wen_evq_pop(&link.evq, &ev) && ev.as.sent.data == big);
+    ASSERT(wen_evq_pop(&link.evq, &ev) && ev.as.sent.data == big + 100);
+}
+#endif // TEST
@@ -19,7 +19,14 @@ static void test_slice_must_be_released(void)
     // DO NOT release slice
     fake_feed(&fio, WEN_WS_OP_TEXT, (unsigned char *)"def", 3);
 
-    // This should assert internally
-    (void)wen_poll(&link, &ev);
+    // No further slice is produced, the data stays buffered
+    ASSERT(!wen_poll(&link, &ev));
+    ASSERT(link.rx_len == 5);
+    ASSERT(wen_link_slices_outstanding(&link) == 1);
+
+    wen_release(&link, ev.as.slice);
+    ASSERT(!wen__poll_decode(&link, &ev));
+    ASSERT(wen_evq_pop(&link.evq, &ev));
+    ASSERT(ev.type == WEN_EV_SLICE);
 }
 #endif
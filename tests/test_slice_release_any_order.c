@@ -0,0 +1,77 @@
+#ifdef TEST
+static void test_slice_release_any_order(void)
+{
+    fake_io fio = {0};
+    wen_link link;
+    wen_event ev;
+    wen_slice s[3];
+
+    wen_io io = {.user=&fio, .read=fake_read, .write=fake_write};
+    ASSERT(wen_link_init(&link, io) == WEN_OK);
+    wen_link_attach_codec(&link, &framed_codec, &link);
+    ASSERT(wen_link_set_slice_limit(&link, WEN_MAX_OUTSTANDING + 1) == WEN_ERR_OVERFLOW);
+    ASSERT(wen_link_set_slice_limit(&link, 3) == WEN_OK);
+
+    while (!wen_poll(&link, &ev));
+    ASSERT(ev.type == WEN_EV_OPEN);
+
+    fake_feed(&fio, WEN_WS_OP_TEXT, (unsigned char *)"one", 3);
+    fake_feed(&fio, WEN_WS_OP_TEXT, (unsigned char *)"two", 3);
+    fake_feed(&fio, WEN_WS_OP_TEXT, (unsigned char *)"three", 5);
+    fake_feed(&fio, WEN_WS_OP_TEXT, (unsigned char *)"four", 4);
+
+    for (int zero_copy = 0; zero_copy < 2; zero_copy++) {
+        wen_arena_snapshot base = link.arena.used;
+
+        // Three slices can be held at once, the fourth has to wait.
+        for (int i = 0; i < 3; i++) {
+            if (i == 0 && !zero_copy) {
+                while (!wen_poll(&link, &ev));
+            } else {
+                ASSERT(!wen__poll_decode(&link, &ev));
+                ASSERT(wen_evq_pop(&link.evq, &ev));
+            }
+            ASSERT(ev.type == WEN_EV_SLICE);
+            s[i] = ev.as.slice;
+        }
+        ASSERT(wen_link_slices_outstanding(&link) == 3);
+        ASSERT(!wen__poll_decode(&link, &ev));
+        ASSERT(!wen_evq_pop(&link.evq, &ev));
+
+        ASSERT(memcmp((const char *)s[0].data + 2, "one", 3) == 0);
+        ASSERT(memcmp((const char *)s[1].data + 2, "two", 3) == 0);
+        ASSERT(memcmp((const char *)s[2].data + 2, "three", 5) == 0);
+
+        // Releasing a middle slice frees nothing yet.
+        wen_release(&link, s[1]);
+        ASSERT(wen_link_slices_outstanding(&link) == 3);
+        ASSERT(memcmp((const char *)s[0].data + 2, "one", 3) == 0);
+        ASSERT(memcmp((const char *)s[2].data + 2, "three", 5) == 0);
+
+        // Releasing the oldest one reclaims it and the middle one.
+        wen_release(&link, s[0]);
+        ASSERT(wen_link_slices_outstanding(&link) == 1);
+        if (zero_copy) ASSERT(link.rx_held == 7);
+
+        ASSERT(!wen__poll_decode(&link, &ev));
+        ASSERT(wen_evq_pop(&link.evq, &ev));
+        ASSERT(memcmp((const char *)ev.as.slice.data + 2, "four", 4) == 0);
+        ASSERT(memcmp((const char *)s[2].data + 2, "three", 5) == 0);
+
+        wen_release(&link, ev.as.slice);
+        wen_release(&link, s[2]);
+        ASSERT(wen_link_slices_outstanding(&link) == 0);
+        ASSERT(link.arena.used == base);
+        ASSERT(link.rx_held == 0 && link.rx_len == 0);
+
+        if (!zero_copy) {
+            ASSERT(wen_link_set_slice_mode(&link, WEN_SLICE_ZERO_COPY) == WEN_OK);
+            fake_feed(&fio, WEN_WS_OP_TEXT, (unsigned char *)"one", 3);
+            fake_feed(&fio, WEN_WS_OP_TEXT, (unsigned char *)"two", 3);
+            fake_feed(&fio, WEN_WS_OP_TEXT, (unsigned char *)"three", 5);
+            fake_feed(&fio, WEN_WS_OP_TEXT, (unsigned char *)"four", 4);
+            ASSERT(wen__poll_read_rx(&link, &ev) == (unsigned)-1);
+        }
+    }
+}
+#endif // TEST
@@ -0,0 +1,67 @@
+#ifdef TEST
+static void test_slice_scratch(void)
+{
+    block_io bio = {0};
+    wen_link link;
+    wen_event ev;
+
+    wen_io io = {.user=&bio, .read=block_read, .write=block_write};
+    ASSERT(wen_link_init(&link, io) == WEN_OK);
+    wen_link_attach_codec(&link, &framed_codec, &link);
+    ASSERT(wen_link_set_slice_limit(&link, 2) == WEN_OK);
+
+    while (!wen_poll(&link, &ev));
+    ASSERT(ev.type == WEN_EV_OPEN);
+
+    fake_feed(&bio.base, WEN_WS_OP_TEXT, (unsigned char *)"one", 3);
+    fake_feed(&bio.base, WEN_WS_OP_TEXT, (unsigned char *)"two", 3);
+    while (!wen_poll(&link, &ev)) bio.read_blocked = 1;
+    ASSERT(ev.type == WEN_EV_SLICE);
+    wen_slice a = ev.as.slice;
+
+    // Scratch memory is a bump allocation on top of the slice.
+    char *scratch = wen_slice_alloc(&link, a, 64);
+    ASSERT(scratch != NULL);
+    memset(scratch, 'x', 64);
+    wen_arena_snapshot after_a = link.arena.used;
+    ASSERT(after_a > a.snapshot);
+
+    while (!wen_poll(&link, &ev));
+    ASSERT(ev.type == WEN_EV_SLICE);
+    wen_slice b = ev.as.slice;
+    ASSERT(memcmp((const char *)b.data + 2, "two", 3) == 0);
+    ASSERT(wen_slice_alloc(&link, a, 32) != NULL);
+
+    // Rolled back once the slice and everything allocated after it are released.
+    wen_release(&link, a);
+    ASSERT(wen_slice_alloc(&link, a, 8) == NULL);
+    ASSERT(link.arena.used > after_a);
+    wen_release(&link, b);
+    ASSERT(link.arena.used == 0);
+    ASSERT(wen_slice_alloc(&link, b, 8) == NULL);
+
+    // Releasing a newer slice first keeps the scratch of an older one.
+    fake_feed(&bio.base, WEN_WS_OP_TEXT, (unsigned char *)"three", 5);
+    fake_feed(&bio.base, WEN_WS_OP_TEXT, (unsigned char *)"four", 4);
+    bio.read_blocked = 0;
+    while (!wen_poll(&link, &ev)) bio.read_blocked = 1;
+    ASSERT(ev.type == WEN_EV_SLICE);
+    a = ev.as.slice;
+    while (!wen_poll(&link, &ev));
+    ASSERT(ev.type == WEN_EV_SLICE);
+    b = ev.as.slice;
+
+    scratch = wen_slice_alloc(&link, a, 64);
+    ASSERT(scratch != NULL);
+    memset(scratch, 'y', 64);
+    wen_arena_snapshot top = link.arena.used;
+    wen_release(&link, b);
+    ASSERT(link.arena.used == top);
+    ASSERT(wen_slice_alloc(&link, a, 16) != NULL);
+    for (int i = 0; i < 64; i++) ASSERT(scratch[i] == 'y');
+    wen_release(&link, a);
+    ASSERT(link.arena.used == 0);
+
+    wen_link_deinit(&link);
+}
+#endif // TEST
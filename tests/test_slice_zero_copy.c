@@ -0,0 +1,64 @@
+#ifdef TEST
+static unsigned long fill_read_requested;
+
+static long fill_read(void *user, void *buf, unsigned long len)
+{
+    WEN_UNUSED(user);
+    fill_read_requested = len;
+    memset(buf, 'x', len);
+    return (long)len;
+}
+
+static void test_slice_zero_copy(void)
+{
+    fake_io fio = {0};
+    wen_link link;
+    wen_event ev;
+
+    wen_io io = {.user=&fio, .read=fake_read, .write=fake_write};
+    ASSERT(wen_link_init(&link, io) == WEN_OK);
+    wen_link_attach_codec(&link, &framed_codec, &link);
+    ASSERT(wen_link_set_slice_mode(&link, WEN_SLICE_ZERO_COPY) == WEN_OK);
+
+    while (!wen_poll(&link, &ev));
+    ASSERT(ev.type == WEN_EV_OPEN);
+
+    fake_feed(&fio, WEN_WS_OP_TEXT, (unsigned char *)"one", 3);
+    fake_feed(&fio, WEN_WS_OP_TEXT, (unsigned char *)"two", 3);
+    while (!wen_poll(&link, &ev));
+    ASSERT(ev.type == WEN_EV_SLICE);
+
+    // The slice is a view of rx_buf, no arena memory is used.
+    ASSERT(ev.as.slice.data == link.rx_buf);
+    ASSERT(link.arena.used == 0);
+    ASSERT(link.rx_held == 5);
+    ASSERT(wen_link_set_slice_mode(&link, WEN_SLICE_COPY) == WEN_ERR_STATE);
+    wen_release(&link, ev.as.slice);
+    ASSERT(link.rx_held == 0);
+
+    ASSERT(!wen__poll_decode(&link, &ev));
+    ASSERT(wen_evq_pop(&link.evq, &ev));
+    ASSERT(ev.as.slice.data == link.rx_buf + 5);
+    wen_release(&link, ev.as.slice);
+    ASSERT(link.rx_off == 0 && link.rx_len == 0 && link.rx_held == 0);
+
+    // Held bytes are never overwritten by reads, even once the ring wraps.
+    link.rx_off = WEN_RX_BUFFER - 4;
+    fake_feed(&fio, WEN_WS_OP_TEXT, (unsigned char *)"three", 5);
+    ASSERT(wen__poll_read_rx(&link, &ev) == (unsigned)-1);
+    ASSERT(!wen__poll_decode(&link, &ev));
+    ASSERT(wen_evq_pop(&link.evq, &ev));
+    ASSERT(ev.as.slice.len == 4);
+    ASSERT(wen__poll_read_rx(&link, &ev) == (unsigned)-1);
+    ASSERT(link.rx_held == 4 && link.rx_len == 3);
+
+    link.io.read = fill_read;
+    ASSERT(wen__poll_read_rx(&link, &ev) == (unsigned)-1);
+    ASSERT(fill_read_requested == WEN_RX_BUFFER - 7);
+    ASSERT(memcmp((const char *)ev.as.slice.data + 2, "th", 2) == 0);
+    ASSERT(memcmp(link.rx_buf, "ree", 3) == 0);
+
+    wen_release(&link, ev.as.slice);
+    ASSERT(link.rx_held == 0 && link.rx_len == WEN_RX_BUFFER - 4);
+}
+#endif // TEST
@@ -0,0 +1,126 @@
+#ifdef TEST
+// Drains [link] and counts the timeouts of [kind] it reported.
+static int timer_events(wen_link *link, wen_timeout kind)
+{
+    wen_event ev;
+    int n = 0;
+    while (wen_poll(link, &ev)) {
+        if (ev.type == WEN_EV_TIMEOUT && ev.as.timeout == kind) n++;
+        if (ev.type == WEN_EV_SLICE) wen_release(link, ev.as.slice);
+    }
+    return n;
+}
+
+static void test_timers(void)
+{
+    static wen_timers timers;
+    block_io bio[2] = {0};
+    wen_link links[2];
+
+    // The clock is driven by hand, starting at 1000 ms with 10 ms ticks.
+    wen_timers_init(&timers, 10, 1000);
+    ASSERT(wen_timers_next(&timers) == -1);
+
+    for (int i = 0; i < 2; i++) {
+        wen_io io = {.user=&bio[i], .read=block_read, .write=block_write};
+        ASSERT(wen_link_init(&links[i], io) == WEN_OK);
+        wen_link_attach_codec(&links[i], &framed_codec, &links[i]);
+        bio[i].read_blocked = 1;
+    }
+
+    // A link that never finishes its handshake is told so, once.
+    wen_timers_add(&timers, &links[0]);
+    wen_link_set_timeouts(&links[0], 50, 0, 0);
+    ASSERT(timers.count == 1);
+    ASSERT(wen_timers_next(&timers) == 50);
+    ASSERT(wen_timers_advance(&timers, 1040) == 0);
+    ASSERT(timer_events(&links[0], WEN_TIMEOUT_HANDSHAKE) == 0);
+    ASSERT(wen_timers_advance(&timers, 1050) == 1);
+    ASSERT(timer_events(&links[0], WEN_TIMEOUT_HANDSHAKE) == 1);
+    ASSERT(wen_timers_next(&timers) == -1);
+
+    // Once open, pings recur and incoming data pushes the idle deadline back.
+    bio[0].read_blocked = 0;
+    fake_feed(&bio[0].base, WEN_WS_OP_TEXT, (unsigned char *)"a", 1);
+    timer_events(&links[0], WEN_TIMEOUT_IDLE);
+    ASSERT(links[0].state == WEN_LINK_OPEN);
+    ASSERT(links[0].last_rx == 1050);
+    bio[0].read_blocked = 1;
+
+    wen_link_set_timeouts(&links[0], 0, 300, 100);
+    ASSERT(wen_timers_next(&timers) == 50);
+    ASSERT(wen_timers_advance(&timers, 1100) == 1);
+    ASSERT(timer_events(&links[0], WEN_TIMEOUT_PING) == 1);
+    ASSERT(wen_timers_advance(&timers, 1200) == 1);
+    ASSERT(timer_events(&links[0], WEN_TIMEOUT_PING) == 1);
+
+    wen_timers_advance(&timers, 1300);
+    bio[0].read_blocked = 0;
+    fake_feed(&bio[0].base, WEN_WS_OP_TEXT, (unsigned char *)"b", 1);
+    ASSERT(timer_events(&links[0], WEN_TIMEOUT_IDLE) == 0);
+    bio[0].read_blocked = 1;
+    ASSERT(links[0].last_rx == 1300);
+
+    wen_timers_advance(&timers, 1590);
+    ASSERT(timer_events(&links[0], WEN_TIMEOUT_IDLE) == 0);
+    wen_timers_advance(&timers, 1600);
+    ASSERT(timer_events(&links[0], WEN_TIMEOUT_IDLE) == 1);
+
+    // A far deadline cascades down the wheel and fires on its own tick.
+    wen_timers_remove(&links[0]);
+    ASSERT(timers.count == 0);
+    ASSERT(wen_timers_next(&timers) == -1);
+
+    wen_timers_add(&timers, &links[1]);
+    wen_link_set_timeouts(&links[1], 100000, 0, 0);
+    unsigned long now = 1600;
+    while (now + 7777 < 101600) {
+        now += 7777;
+        ASSERT(wen_timers_advance(&timers, now) == 0);
+        ASSERT(wen_timers_next(&timers) <= (long)(101600 - now));
+    }
+    ASSERT(wen_timers_advance(&timers, 101590) == 0);
+    ASSERT(wen_timers_advance(&timers, 101600) == 1);
+    ASSERT(timer_events(&links[1], WEN_TIMEOUT_HANDSHAKE) == 1);
+
+    wen_timers_remove(&links[1]);
+    for (int i = 0; i < 2; i++) wen_link_deinit(&links[i]);
+
+    // A pooled link stays on the wheel while its idle buffers are returned.
+    wen_buffer_pool pool;
+    wen_link_config sizes = {.rx_size=512, .tx_size=512};
+    ASSERT(wen_buffer_pool_init(&pool, &sizes, 1) == WEN_OK);
+    wen_link_config cfg = {.pool=&pool};
+    memset(&bio[0], 0, sizeof(bio[0]));
+    wen_io io = {.user=&bio[0], .read=block_read, .write=block_write};
+    ASSERT(wen_link_init_ex(&links[0], io, &cfg) == WEN_OK);
+    wen_link_attach_codec(&links[0], &framed_codec, &links[0]);
+    wen_timers_add(&timers, &links[0]);
+    wen_link_set_timeouts(&links[0], 0, 0, 100);
+
+    wen_event ev;
+    while (!wen_poll(&links[0], &ev));
+    ASSERT(ev.type == WEN_EV_OPEN);
+    bio[0].read_blocked = 1;
+    for (int i = 0; i < 3; i++) {
+        ASSERT(!wen_poll(&links[0], &ev));
+        ASSERT(!wen_link_has_buffers(&links[0]));
+        ASSERT(links[0].timers == &timers && timers.count == 1);
+        ASSERT(wen_timers_advance(&timers, 101700 + 100 * (unsigned long)i) == 1);
+        ASSERT(timer_events(&links[0], WEN_TIMEOUT_PING) == 1);
+    }
+
+    // A clock that steps back or wraps around does not stall the wheel.
+    ASSERT(wen_timers_advance(&timers, 50) == 0);
+    ASSERT(timers.now == 101900);
+    ASSERT(wen_timers_advance(&timers, 149) == 0);
+    ASSERT(wen_timers_advance(&timers, 150) == 1);
+    ASSERT(timer_events(&links[0], WEN_TIMEOUT_PING) == 1);
+    ASSERT(timers.now == 102000);
+
+    // Closing takes it off.
+    wen_link_deinit(&links[0]);
+    ASSERT(timers.count == 0);
+    wen_buffer_pool_free(&pool);
+}
+#endif
@@ -0,0 +1,95 @@
+#ifdef TEST
+typedef struct {
+    fake_io base;
+    unsigned long max_write;
+
+    unsigned char out[3 * WEN_TX_BUFFER];
+    unsigned long out_len;
+} slow_io;
+
+static long slow_read(void *user, void *buf, unsigned long len)
+{
+    slow_io *io = user;
+    return fake_read(&io->base, buf, len);
+}
+
+static long slow_write(void *user, const void *buf, unsigned long len)
+{
+    slow_io *io = user;
+    unsigned long n = WEN_MIN(len, io->max_write);
+    ASSERTN(io->out_len + n <= sizeof(io->out));
+
+    memcpy(io->out + io->out_len, buf, n);
+    io->out_len += n;
+    return (long)n;
+}
+
+static wen_result capped_encode(void *codec_state, unsigned opcode, const void *data, unsigned long len,
+                                void *out, unsigned long out_cap, unsigned long *out_len)
+{
+    if (out_cap < 2 + len) return WEN_ERR_OVERFLOW;
+    return fake_encode(codec_state, opcode, data, len, out, out_cap, out_len);
+}
+
+static const wen_codec capped_codec = {
+    .name = "capped",
+    .handshake = fake_handshake,
+    .decode = fake_decode,
+    .encode = capped_encode
+};
+
+static void test_tx_cursor_partial_write(void)
+{
+    static slow_io sio;
+    wen_link link;
+    wen_event ev;
+
+    memset(&sio, 0, sizeof(sio));
+    sio.max_write = 3;
+
+    wen_io io = {.user=&sio, .read=slow_read, .write=slow_write};
+    ASSERT(wen_link_init(&link, io) == WEN_OK);
+    wen_link_attach_codec(&link, &capped_codec, NULL);
+
+    while (!wen_poll(&link, &ev));
+    ASSERT(ev.type == WEN_EV_OPEN);
+
+    ASSERT(wen_send(&link, WEN_WS_OP_TEXT, "hello", 5) == WEN_OK);
+    ASSERT(wen_send(&link, WEN_WS_OP_TEXT, "world", 5) == WEN_OK);
+    ASSERT(link.tx_len == 14);
+
+    // A short write advances the cursor, the backlog stays where it is.
+    ASSERT(!wen__poll_flush_tx(&link, &ev));
+    ASSERT(link.tx_off == 3);
+    ASSERT(link.tx_len == 11);
+    ASSERT(memcmp(link.tx_buf + 7 + 2, "world", 5) == 0);
+
+    // Fill the tail until the next frame no longer fits after the backlog.
+    unsigned char payload[125];
+    memset(payload, 'p', sizeof(payload));
+    while (link.tx_off + link.tx_len + 2 + sizeof(payload) <= WEN_TX_BUFFER)
+        ASSERT(wen_send(&link, WEN_WS_OP_BINARY, payload, sizeof(payload)) == WEN_OK);
+
+    sio.max_write = 2 * (2 + sizeof(payload));
+    ASSERT(!wen__poll_flush_tx(&link, &ev));
+    ASSERT(link.tx_off > 2 + sizeof(payload));
+
+    // The next frame continues at the front of tx_buf.
+    unsigned long before = link.tx_len;
+    memset(payload, 'q', sizeof(payload));
+    ASSERT(wen_send(&link, WEN_WS_OP_BINARY, payload, sizeof(payload)) == WEN_OK);
+    ASSERT(link.tx_wrap == 2 + sizeof(payload));
+    ASSERT(link.tx_len == before + 2 + sizeof(payload));
+    ASSERT(memcmp(link.tx_buf + 2, payload, sizeof(payload)) == 0);
+
+    sio.max_write = WEN_TX_BUFFER;
+    while (link.tx_len) ASSERT(!wen__poll_flush_tx(&link, &ev));
+    ASSERT(link.tx_off == 0 && link.tx_wrap == 0);
+
+    // Everything went out in order.
+    ASSERT(memcmp(sio.out + 2, "hello", 5) == 0);
+    ASSERT(memcmp(sio.out + 9, "world", 5) == 0);
+    ASSERT(memcmp(sio.out + sio.out_len - sizeof(payload), payload, sizeof(payload)) == 0);
+    ASSERT(sio.out[sio.out_len - sizeof(payload) - 1] == sizeof(payload));
+}
+#endif // TEST
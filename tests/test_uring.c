@@ -0,0 +1,129 @@
+#ifdef TEST
+// Runs [ring] and polls [link] until it reports an event of [type].
+static bool uring_poll_until(wen_uring *ring, wen_link *link, wen_event_type type, wen_event *ev)
+{
+    for (int tries = 0; tries < 16; tries++) {
+        if (wen_uring_run(ring, 100) < 0) return false;
+        while (wen_poll(link, ev))
+            if (ev->type == type) return true;
+    }
+    return false;
+}
+
+static void test_uring(void)
+{
+    wen_uring ring;
+    wen_result r = wen_uring_init(&ring, 0, 8, 1024);
+    if (r == WEN_ERR_UNSUPPORTED) return;
+    ASSERT(r == WEN_OK);
+
+#if defined(__linux__)
+    int sv[2];
+    wen_loop loop;
+    wen_link link;
+    wen_uring_conn conn;
+    wen_loop_event out[8];
+    unsigned char buf[16];
+
+    ASSERT(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv) == 0);
+    ASSERT(wen_loop_init_uring(&loop, &ring) == WEN_OK);
+
+    wen_io io;
+    ASSERT(wen_uring_conn_init(&conn, &ring, sv[0], &io) == WEN_OK);
+    ASSERT(ring.send_available == 7);
+    ASSERT(wen_link_init(&link, io) == WEN_OK);
+    wen_link_attach_codec(&link, &framed_codec, &link);
+    ASSERT(wen_loop_add(&loop, &link, sv[0]) == WEN_OK);
+    ASSERT(conn.link == &link);
+
+    // The first poll arms a multishot receive; nothing is read yet.
+    ASSERT(wen_loop_run(&loop, out, 8, 0) == 0);
+    ASSERT(conn.rx_armed);
+
+    ASSERT(write(sv[1], "x", 1) == 1);
+    int i = loop_until(&loop, out, 8, WEN_EV_OPEN);
+    ASSERT(i >= 0);
+    ASSERT(out[i].link == &link);
+
+    // Several frames in a row come back from the same submission.
+    ASSERT(write(sv[1], "\x81\x02hi", 4) == 4);
+    i = loop_until(&loop, out, 8, WEN_EV_SLICE);
+    ASSERT(i >= 0);
+    ASSERT(out[i].ev.as.slice.len == 4);
+    ASSERT(memcmp(out[i].ev.as.slice.data, "\x81\x02hi", 4) == 0);
+    wen_release(&link, out[i].ev.as.slice);
+
+    ASSERT(write(sv[1], "\x81\x01!", 3) == 3);
+    i = loop_until(&loop, out, 8, WEN_EV_SLICE);
+    ASSERT(i >= 0);
+    ASSERT(out[i].ev.as.slice.len == 3);
+    wen_release(&link, out[i].ev.as.slice);
+
+    // Frames reaped into several buffers before a run are all read in it,
+    // not just the first buffer.
+    wen_link_set_slice_limit(&link, 4);
+    ASSERT(write(sv[1], "\x81\x02" "ab", 4) == 4);
+    ASSERT(write(sv[1], "\x81\x02" "cd", 4) == 4);
+    ASSERT(write(sv[1], "\x81\x02" "ef", 4) == 4);
+    int slices = 0;
+    for (int tries = 0; tries < 8 && slices < 3; tries++) {
+        unsigned n = wen_loop_run(&loop, out, 8, 100);
+        for (unsigned k = 0; k < n; k++) {
+            if (out[k].ev.type != WEN_EV_SLICE) continue;
+            ASSERT(((const char *)out[k].ev.as.slice.data)[2] == "ace"[slices]);
+            wen_release(&link, out[k].ev.as.slice);
+            slices++;
+        }
+    }
+    ASSERT(slices == 3);
+    ASSERT(conn.rx_head == WEN__URING_NONE);
+
+    // Output is copied into the send buffer and submitted on the next run.
+    ASSERT(wen_send(&link, WEN_WS_OP_TEXT, "yo", 2) == WEN_OK);
+    wen_loop_run(&loop, out, 8, 0);
+    ASSERT(link.tx_len == 0);
+    for (int tries = 0; tries < 8 && conn.tx_busy; tries++) wen_loop_run(&loop, out, 8, 100);
+    ASSERT(!conn.tx_busy);
+    ASSERT(read(sv[1], buf, sizeof(buf)) == 4);
+    ASSERT(memcmp(buf + 2, "yo", 2) == 0);
+
+    close(sv[1]);
+    i = loop_until(&loop, out, 8, WEN_EV_CLOSE);
+    ASSERT(i >= 0);
+    ASSERT(link.loop == NULL && conn.link == NULL);
+
+    wen_uring_conn_close(&conn);
+    ASSERT(ring.send_available == 8);
+    wen_loop_free(&loop);
+    close(sv[0]);
+
+    // Without a ring loop the links are polled directly and the ring is run by hand.
+    ASSERT(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv) == 0);
+    ASSERT(wen_loop_init(&loop) == WEN_OK);
+    ASSERT(wen_uring_conn_init(&conn, &ring, sv[0], &io) == WEN_OK);
+    ASSERT(wen_link_init(&link, io) == WEN_OK);
+    wen_link_attach_codec(&link, &framed_codec, &link);
+    ASSERT(wen_loop_add(&loop, &link, sv[0]) == WEN_ERR_STATE);
+    wen_loop_free(&loop);
+
+    wen_event ev;
+    ASSERT(!wen_poll(&link, &ev));
+    ASSERT(conn.rx_armed);
+    ASSERT(write(sv[1], "x", 1) == 1);
+    ASSERT(uring_poll_until(&ring, &link, WEN_EV_OPEN, &ev));
+    ASSERT(write(sv[1], "\x81\x02ok", 4) == 4);
+    ASSERT(uring_poll_until(&ring, &link, WEN_EV_SLICE, &ev));
+    ASSERT(memcmp((const char *)ev.as.slice.data + 2, "ok", 2) == 0);
+    wen_release(&link, ev.as.slice);
+
+    // Closing with the receive still armed cancels it first.
+    ASSERT(conn.inflight);
+    wen_uring_conn_close(&conn);
+    ASSERT(ring.send_available == 8);
+    wen_link_deinit(&link);
+    close(sv[0]);
+    close(sv[1]);
+#endif
+    wen_uring_free(&ring);
+}
+#endif
@@ -0,0 +1,90 @@
+#ifdef TEST
+typedef struct {
+    slow_io base;
+    int readv_calls;
+    int writev_calls;
+} vec_io;
+
+static long vec_readv(void *user, const wen_iovec *iov, unsigned iovcnt)
+{
+    vec_io *io = user;
+    long total = 0;
+
+    io->readv_calls++;
+    for (unsigned i = 0; i < iovcnt; i++) {
+        long n = fake_read(&io->base.base, iov[i].base, iov[i].len);
+        if (n <= 0) break;
+        total += n;
+        if ((unsigned long)n < iov[i].len) break;
+    }
+    return total;
+}
+
+static long vec_writev(void *user, const wen_iovec *iov, unsigned iovcnt)
+{
+    vec_io *io = user;
+    long total = 0;
+
+    io->writev_calls++;
+    for (unsigned i = 0; i < iovcnt; i++) {
+        long n = slow_write(&io->base, iov[i].base, iov[i].len);
+        total += n;
+        if ((unsigned long)n < iov[i].len) break;
+    }
+    return total;
+}
+
+static const wen_codec vec_codec = {
+    .name = "vec",
+    .handshake = fake_handshake,
+    .decode = framed_decode,
+    .encode = capped_encode
+};
+
+static void test_vectored_io(void)
+{
+    static vec_io vio;
+    wen_link link;
+    wen_event ev;
+
+    memset(&vio, 0, sizeof(vio));
+    vio.base.max_write = WEN_TX_BUFFER;
+
+    wen_io io = {
+        .user = &vio,
+        .read = slow_read,
+        .write = slow_write,
+        .readv = vec_readv,
+        .writev = vec_writev
+    };
+    ASSERT(wen_link_init(&link, io) == WEN_OK);
+    wen_link_attach_codec(&link, &vec_codec, &link);
+
+    while (!wen_poll(&link, &ev));
+    ASSERT(ev.type == WEN_EV_OPEN);
+
+    // Both halves of a wrapped TX backlog go out with one call.
+    unsigned char payload[125];
+    memset(payload, 'p', sizeof(payload));
+    while (link.tx_off + link.tx_len + 2 + sizeof(payload) <= WEN_TX_BUFFER)
+        ASSERT(wen_send(&link, WEN_WS_OP_BINARY, payload, sizeof(payload)) == WEN_OK);
+    link.tx_off += 2 + sizeof(payload);
+    link.tx_len -= 2 + sizeof(payload);
+    ASSERT(wen_send(&link, WEN_WS_OP_BINARY, payload, sizeof(payload)) == WEN_OK);
+    ASSERT(link.tx_wrap > 0);
+
+    unsigned long pending = link.tx_len;
+    ASSERT(!wen__poll_flush_tx(&link, &ev));
+    ASSERT(vio.writev_calls == 1);
+    ASSERT(vio.base.out_len == pending);
+    ASSERT(link.tx_len == 0 && link.tx_off == 0 && link.tx_wrap == 0);
+
+    // Both free halves of the RX ring are filled with one call.
+    link.rx_off = WEN_RX_BUFFER - 4;
+    fake_feed(&vio.base.base, WEN_WS_OP_TEXT, (unsigned char *)"three", 5);
+    ASSERT(wen__poll_read_rx(&link, &ev) == (unsigned)-1);
+    ASSERT(vio.readv_calls == 1);
+    ASSERT(link.rx_len == 7);
+    ASSERT(memcmp(link.rx_buf, "ree", 3) == 0);
+}
+#endif // TEST
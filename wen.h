@@ -61,12 +61,71 @@
 
      All temporary allocations use a user-owned arena (wen_arena).
      Slices returned to the user remain valid until wen_release() is called.
+     By default slice data is copied into the arena; with WEN_SLICE_ZERO_COPY
+     it points straight into the link's receive buffer instead.
      Individual allocations cannot be freed; arenas are reset in bulk.
-     At most one slice event may be outstanding at any time.
-     The caller must call wen_release() before the next slice can be produced.
-     Incoming data may be buffered until the slice is released.
+     By default at most one slice may be outstanding at any time; raise the
+     limit with wen_link_set_slice_limit(). Slices may be released in any order.
+     Once the limit is reached no further slices are produced and incoming
+     data stays buffered until a slice is released.
+     wen_slice_alloc() hands out scratch memory for handling a slice from the
+     same arena; it is rolled back when the slice is released.
+
+     Payloads passed to wen_send_ref() are borrowed, not copied, and must stay
+     untouched until the matching WEN_EV_SENT event is returned.
+
+     Each link keeps its receive buffer, transmit buffer and arena in one
+     block allocated by wen_link_init(). wen_link_init_ex() sizes them per link
+     or carves them out of caller-provided memory, e.g. a wen_region mapped
+     with huge pages and prefaulted at startup.
+
+     If WEN_NO_MALLOC is enabled, no calls to malloc/free/realloc are made and
+     every link needs caller-provided memory.
+
+   # Event Loop
+
+     wen_poll() never blocks by itself; driving many links is up to the
+     caller. On Linux, wen_loop does it with epoll: register each link with
+     its non-blocking socket and call wen_loop_run(), which sleeps until some
+     socket is ready and polls only the links that have something to do.
+
+        wen_loop_event events[64];
+        for (;;) {
+            unsigned n = wen_loop_run(&loop, events, 64, -1);
+            for (unsigned i = 0; i < n; i++)
+                handle(events[i].link, events[i].ev);
+        }
+
+     Each ready link gets one turn per wen_loop_run(), limited in events and
+     bytes by wen_loop_set_quantum(), so a client that floods its socket
+     cannot hold up the others.
+
+     wen_loop_set_spin() trades a core for latency: after every burst the
+     loop keeps polling without sleeping for a while, so the next message is
+     picked up without a wakeup.
+
+     Applications with a loop of their own can poll with wen_poll_interest(),
+     which tells whether the link wants to read, has output to write or has
+     more events ready, and when its next deadline is due.
 
-     If WEN_NO_MALLOC is enabled, no calls to malloc/free/realloc are made.
+     Instead of switching on ev.type, a link can be given wen_handlers with
+     wen_link_set_handlers() and driven by wen_dispatch(). Slices then reach
+     on_slice() straight from the decoder, skipping the event queue.
+
+     A loop set up with wen_loop_init_uring() waits on an io_uring instead.
+     Links whose transport comes from wen_uring_conn_init() then batch their
+     reads and writes into one io_uring_enter() per wen_loop_run(). Without
+     such a loop, call wen_uring_run() between polls to move their I/O along.
+
+   # Timers
+
+     wen_timers is a hierarchical timing wheel. Links added to it with
+     wen_timers_add() get WEN_EV_TIMEOUT events when their handshake takes
+     too long, when nothing was read for a while and when a ping is due, as
+     set by wen_link_set_timeouts(). Feed it the time with
+     wen_timers_advance(), or hand it to wen_loop_set_timers() and the loop
+     keeps it running. Deadlines are rounded up to WEN_TIMER_TICK_MS by
+     default.
 
    # Thread Safety
 
@@ -75,6 +134,9 @@
      Each wen_link must be confined to a single thread.
      Synchronization is the responsibility of the caller.
 
+     To use more cores, wen_runtime runs one wen_loop per thread, each with
+     its own SO_REUSEPORT listener and links, so shards share nothing.
+
    # Error Handling
 
      Errors are reported explicitly via:
@@ -96,10 +158,14 @@
      ## Size Limits
 
         - WEN_MAX_SLICE - Maximum size of a slice returned to the user.
-        - WEN_RX_BUFFER - Internal receive buffer size per link.
-        - WEN_TX_BUFFER - Internal transmit buffer size per link.
+        - WEN_RX_BUFFER - Default receive buffer size per link.
+        - WEN_TX_BUFFER - Default transmit buffer size per link.
+        - WEN_LOOP_BATCH - Readiness notifications handled per wen_loop_run() step.
+        - WEN_LOOP_QUANTUM - Events one link may return per wen_loop_run() step.
+        - WEN_LOOP_QUANTUM_BYTES - Bytes one link earns per wen_loop_run() step.
 
         These are compile-time constants and must be large enough for your protocol.
+        wen_link_init_ex() overrides the buffer sizes per link.
 */
 
 #ifndef WEN_H_
@@ -136,11 +202,78 @@
 #    define WEN_TX_BUFFER 8192
 #endif
 
+// Smallest buffer size accepted by wen_link_init_ex().
+#ifndef WEN_MIN_BUFFER
+#    define WEN_MIN_BUFFER 128
+#endif
+
 // Maximum number of events that can be queued internally
 #ifndef WEN_EVENT_QUEUE_CAP
 #    define WEN_EVENT_QUEUE_CAP 16
 #endif
 
+// Maximum number of slices a link can keep outstanding at once.
+//
+// Must be a power of two. The per-link limit is set with wen_link_set_slice_limit().
+#ifndef WEN_MAX_OUTSTANDING
+#    define WEN_MAX_OUTSTANDING 8
+#endif
+
+// Huge page size assumed when mapping a region with WEN_REGION_HUGE_PAGES.
+#ifndef WEN_HUGE_PAGE_SIZE
+#    define WEN_HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+#endif
+
+// Maximum number of payloads queued by wen_send_ref() per link.
+#ifndef WEN_TX_REFS
+#    define WEN_TX_REFS 8
+#endif
+
+// Maximum number of buffers passed to a single vectored I/O call.
+#ifndef WEN_IOV_MAX
+#    define WEN_IOV_MAX 8
+#endif
+
+// Maximum number of readiness notifications, and of events per link, handled
+// by a single wen_loop_run() step.
+#ifndef WEN_LOOP_BATCH
+#    define WEN_LOOP_BATCH 64
+#endif
+
+// Drain mode reads per poll for links added to a wen_loop, see wen_link_set_drain().
+#ifndef WEN_LOOP_DRAIN_READS
+#    define WEN_LOOP_DRAIN_READS 4
+#endif
+
+// Default per-link round budgets of a wen_loop, see wen_loop_set_quantum().
+#ifndef WEN_LOOP_QUANTUM
+#    define WEN_LOOP_QUANTUM 16
+#endif
+
+#ifndef WEN_LOOP_QUANTUM_BYTES
+#    define WEN_LOOP_QUANTUM_BYTES 65536
+#endif
+
+// Resolution of a wen_timers wheel in milliseconds, unless given to wen_timers_init().
+#ifndef WEN_TIMER_TICK_MS
+#    define WEN_TIMER_TICK_MS 10
+#endif
+
+// Default listen backlog of every wen_runtime shard.
+#ifndef WEN_RUNTIME_BACKLOG
+#    define WEN_RUNTIME_BACKLOG 1024
+#endif
+
+// Default submission queue size of a wen_uring.
+#ifndef WEN_URING_ENTRIES
+#    define WEN_URING_ENTRIES 256
+#endif
+
+// Default size of the receive and send buffers of a wen_uring.
+#ifndef WEN_URING_BUFFER
+#    define WEN_URING_BUFFER 16384
+#endif
+
 #ifndef WENDEF
 #    define WENDEF static inline
 #endif
@@ -181,7 +314,8 @@ typedef enum {
     WEN_ERR_OVERFLOW,
     WEN_ERR_STATE,
     WEN_ERR_UNSUPPORTED,
-    WEN_ERR_CLOSED
+    WEN_ERR_CLOSED,
+    WEN_ERR_BUDGET
 } wen_result;
 
 // Current state of a link.
@@ -200,6 +334,14 @@ typedef enum {
     WEN_SLICE_END   = 1 << 2
 } wen_slice_flags;
 
+// Where slice data is served from.
+typedef enum {
+    // Slices are copied into the link arena (default).
+    WEN_SLICE_COPY = 0,
+    // Slices point straight into rx_buf; the bytes are retired by wen_release().
+    WEN_SLICE_ZERO_COPY
+} wen_slice_mode;
+
 // Type of event produced by wen_poll().
 typedef enum {
     WEN_EV_NONE = 0,
@@ -211,32 +353,120 @@ typedef enum {
     WEN_EV_PONG,
 #endif // WEN_ENABLE_WS
     WEN_EV_CLOSE,
-    WEN_EV_ERROR
+    WEN_EV_ERROR,
+    // New types are appended so that existing values stay put.
+    WEN_EV_TIMEOUT,
+    WEN_EV_SENT
 } wen_event_type;
 
+// Deadline reported by a WEN_EV_TIMEOUT event, see wen_link_set_timeouts().
+typedef enum {
+    // The handshake did not complete in time.
+    WEN_TIMEOUT_HANDSHAKE = 1,
+    // Nothing was received for the idle timeout.
+    WEN_TIMEOUT_IDLE,
+    // The ping interval elapsed; the application sends a keepalive.
+    WEN_TIMEOUT_PING
+} wen_timeout;
+
+// What a link waits for after a poll, see wen_poll_interest().
+typedef enum {
+    // Poll once the transport is readable.
+    WEN_WANT_READ = 1 << 0,
+    // Output is queued; poll once the transport is writable.
+    WEN_WANT_WRITE = 1 << 1,
+    // Events or buffered frames are ready; poll again without waiting.
+    WEN_HAS_EVENTS = 1 << 2
+} wen_interest;
+
+typedef struct wen_page_pool wen_page_pool;
+
 // An allocation arena with linear growth.
 //
 // Memory allocated from the arena is freed all at once by resetting it.
 // Individual allocations cannot be freed.
+//
+// A chained arena (wen_arena_chain()) takes fixed-size pages from a page pool
+// once the base block is full. Offsets are then logical: [used] keeps growing
+// past [capacity], and resetting below the start of a page returns it.
 typedef struct {
     unsigned char *base;
     unsigned long capacity;
     unsigned long used;
     bool owns_memory;
+
+    // Newest chained page and the logical offset its data starts at.
+    wen_page_pool *pages;
+    unsigned char *page;
+    unsigned long page_start;
 } wen_arena;
 
+// A free list of equally sized pages that chained arenas grow into.
+struct wen_page_pool {
+    unsigned long page_size;
+
+    unsigned char *mem;
+    bool owns_memory;
+
+    void *free_list;
+    unsigned count;
+    unsigned available;
+};
+
 // A snapshot of the arena state.
 //
 // Used to roll back temporary allocations.
 typedef unsigned long wen_arena_snapshot;
 
+// Options for wen_region_map().
+typedef enum {
+    // Back the region with explicit huge pages, or ask for transparent huge
+    // pages when none are reserved.
+    WEN_REGION_HUGE_PAGES = 1 << 0,
+    // Fault every page in at map time.
+    WEN_REGION_PREFAULT = 1 << 1,
+    // Lock the region in memory.
+    WEN_REGION_LOCK = 1 << 2
+} wen_region_flags;
+
+// One large mapping that link buffers, arenas and pools are carved out of.
+//
+// Keeps the memory of many links on few TLB entries and, once prefaulted, free
+// of first-touch page faults. Allocations are only returned by unmapping.
+typedef struct {
+    unsigned char *base;
+    unsigned long size;
+    unsigned long used;
+
+    // Mapped with explicit huge pages.
+    bool huge;
+} wen_region;
+
+// A buffer passed to the vectored I/O callbacks.
+typedef struct {
+    void *base;
+    unsigned long len;
+} wen_iovec;
+
+// Returned by wen_io callbacks when the transport cannot make progress right now,
+// e.g. a non-blocking socket reporting EAGAIN.
+#define WEN_IO_WOULD_BLOCK (-2L)
+
 // Transport abstraction used by wen.
 //
 // The user provides read/write callbacks backed by TCP, TLS, or something else.
+// readv/writev are optional; when set, wen uses them to fill or flush several
+// buffers with one call and falls back to read/write otherwise.
+//
+// Callbacks return the number of bytes transferred, 0 from a read for end of
+// stream, WEN_IO_WOULD_BLOCK when nothing can be transferred right now, and
+// any other negative value on error.
 typedef struct wen_io {
     void *user;
     long (*read)(void *user, void *buf, unsigned long len);
     long (*write)(void *user, const void *buf, unsigned long len);
+    long (*readv)(void *user, const wen_iovec *iov, unsigned iovcnt);
+    long (*writev)(void *user, const wen_iovec *iov, unsigned iovcnt);
 } wen_io;
 
 // A zero-copy view into received data.
@@ -247,8 +477,18 @@ typedef struct {
     unsigned long len;
     unsigned flags;
     wen_arena_snapshot snapshot;
+    unsigned handle;
 } wen_slice;
 
+// Bookkeeping for an outstanding slice.
+typedef struct {
+    unsigned long held;
+    wen_arena_snapshot snapshot;
+    // Arena high-water mark of the slice data and its scratch memory.
+    wen_arena_snapshot top;
+    bool released;
+} wen_slice_slot;
+
 // Metadata for a decoded wire frame.
 //
 // This is exposed for protocol inspection and debugging.
@@ -259,15 +499,26 @@ typedef struct {
     unsigned long long length;
 } wen_frame;
 
+// Completion of a payload queued with wen_send_ref().
+//
+// Once this is reported, wen no longer references the payload.
+typedef struct {
+    const void *data;
+    unsigned long len;
+    void *user;
+} wen_sent;
+
 // Event returned by wen_poll().
 //// Only the union member corresponding to the event type is valid.
 typedef struct {
     wen_event_type type;
     union {
         wen_slice slice;
+        wen_sent sent;
         wen_frame frame;
         unsigned close_code;
         wen_result error;
+        wen_timeout timeout;
     } as;
 } wen_event;
 
@@ -300,8 +551,25 @@ typedef struct wen_codec {
     // Encodes an outgoing message or control frame.
     wen_result (*encode)(void *codec_state, unsigned opcode, const void *data, unsigned long len,
                          void *out, unsigned long out_cap, unsigned long *out_len);
+
+    // Encodes only the header of a message whose [len] byte payload follows it on the wire.
+    //
+    // Optional. Required by wen_send_ref().
+    wen_result (*encode_header)(void *codec_state, unsigned opcode, unsigned long len,
+                                void *out, unsigned long out_cap, unsigned long *out_len);
 } wen_codec;
 
+// A caller-owned payload queued by wen_send_ref().
+typedef struct {
+    const void *data;
+    unsigned long len;
+    unsigned long sent;
+
+    // tx_buf bytes that go out between the previous payload and this one.
+    unsigned long before;
+    void *user;
+} wen_tx_ref;
+
 // Fixed-capacity ring buffer for queued events.
 typedef struct {
     wen_event q[WEN_EVENT_QUEUE_CAP];
@@ -309,33 +577,490 @@ typedef struct {
     unsigned tail;
 } wen_event_queue;
 
+typedef struct wen_buffer_pool wen_buffer_pool;
+
+// A node of a wen_timers wheel, embedded in each link.
+typedef struct wen_timer {
+    struct wen_timer *next;
+    struct wen_timer *prev;
+    unsigned long long expires;
+
+    // Level and slot the node is linked into.
+    unsigned slot;
+} wen_timer;
+
+#define WEN__TIMER_LEVELS 4
+#define WEN__TIMER_BITS 6
+#define WEN__TIMER_SLOTS (1 << WEN__TIMER_BITS)
+
+// Hierarchical timing wheel driving the handshake, idle and ping deadlines of
+// many links.
+//
+// Each link sits in one slot for its earliest deadline, so scheduling, moving
+// and expiring a link are O(1) no matter how many links there are. Activity
+// only stamps the link; a deadline that moved is noticed, and the link
+// rescheduled, when its slot comes up. Four levels of 64 slots cover
+// 2^24 ticks; later deadlines are clamped and rescheduled on the way.
+// Time is the caller's, in milliseconds, passed to wen_timers_advance().
+// The wheel only moves forward; a clock that steps back or wraps around is
+// rebased onto the time the wheel already reached.
+typedef struct wen_timers {
+    unsigned long tick_ms;
+    unsigned long long now;
+    unsigned long long ticks;
+    unsigned count;
+
+    // Added to the caller's clock to get the wheel time.
+    unsigned long long skew;
+
+    // Heads of the slot lists, with a bit per non-empty slot.
+    wen_timer slots[WEN__TIMER_LEVELS][WEN__TIMER_SLOTS];
+    unsigned long long used[WEN__TIMER_LEVELS];
+} wen_timers;
+
+// Memory accounting shared by a group of links.
+//
+// Links charge the buffer memory they hold against [limit] (0 for no limit)
+// and are refused with WEN_ERR_BUDGET once it would be exceeded. Other memory,
+// such as codec state, is accounted with wen_budget_charge().
+typedef struct {
+    unsigned long limit;
+    unsigned long used;
+    unsigned long peak;
+} wen_budget;
+
+// Per-link buffer configuration for wen_link_init_ex().
+//
+// Zero sizes fall back to WEN_RX_BUFFER, WEN_TX_BUFFER and rx_size + tx_size
+// for the arena. When [mem] is set the buffers are carved out of it instead of
+// being allocated; it must hold at least wen_link_mem_size() bytes and outlive
+// the link. When [pool] is set the sizes come from the pool and the link only
+// borrows a block from it while it has data buffered.
+typedef struct {
+    unsigned long rx_size;
+    unsigned long tx_size;
+    unsigned long arena_size;
+
+    void *mem;
+    unsigned long mem_size;
+
+    wen_buffer_pool *pool;
+    wen_budget *budget;
+
+    // Lets the link arena grow into pages from this pool, see wen_arena_chain().
+    wen_page_pool *arena_pages;
+} wen_link_config;
+
+// A free list of equally sized link buffer blocks shared by many links.
+//
+// Like links, a pool must be confined to a single thread; use one pool per
+// thread.
+struct wen_buffer_pool {
+    wen_link_config config;
+    unsigned long block_size;
+
+    unsigned char *mem;
+    bool owns_memory;
+
+    void *free_list;
+    unsigned count;
+    unsigned available;
+
+    // Links that found the pool empty, woken in turn as blocks come back.
+    struct wen_link *waiters;
+    struct wen_link *waiters_tail;
+};
+
 // Represents a single wire connection.
 //
-// A link owns its buffers, codec state, and event queue.
+// A link owns its buffers, codec state, and event queue. The fields touched on
+// every poll come first; the buffers themselves live out of line.
 typedef struct wen_link {
     wen_link_state state;
-    wen_io io;
+    bool close_queued;
+    bool rx_drained;
+
+    // The last write reported WEN_IO_WOULD_BLOCK.
+    bool tx_blocked;
 
-    unsigned char rx_buf[WEN_RX_BUFFER];
+    // rx_buf is a ring of rx_cap bytes: rx_len bytes are pending starting at
+    // rx_off. In WEN_SLICE_ZERO_COPY mode the rx_held bytes right before rx_off
+    // still back an outstanding slice.
+    unsigned char *rx_buf;
+    unsigned long rx_cap;
+    unsigned long rx_off;
     unsigned long rx_len;
+    unsigned long rx_held;
 
-    unsigned char tx_buf[WEN_TX_BUFFER];
+    // tx_buf holds tx_len pending bytes starting at tx_off. When the tail is too
+    // small for the next frame, the last tx_wrap of them continue at the front.
+    unsigned char *tx_buf;
+    unsigned long tx_cap;
+    unsigned long tx_off;
     unsigned long tx_len;
+    unsigned long tx_wrap;
 
     // bytes of current frame
     unsigned long frame_len;
 
+    // Part of the current frame was already delivered in an earlier slice.
+    bool frame_split;
+
     const wen_codec *codec;
     void *codec_state;
+    wen_io io;
+
+    // Payloads referenced in place, in wire order. The first tx_ref_done of
+    // them are fully written but not yet reported with WEN_EV_SENT.
+    unsigned tx_ref_head;
+    unsigned tx_ref_count;
+    unsigned tx_ref_done;
+    unsigned long tx_ref_bytes;
+
+    // Outstanding slices, indexed by handle. Handles slice_first up to
+    // slice_next are live; at most slice_limit of them at a time.
+    unsigned slice_first;
+    unsigned slice_next;
+    unsigned slice_limit;
+    wen_arena_snapshot slice_arena_base;
+    wen_slice_mode slice_mode;
+
+    // Drain mode budget per poll, see wen_link_set_drain().
+    unsigned drain_reads;
+    unsigned long drain_bytes;
 
     void *user_data;
-    wen_event_queue evq;
     wen_arena arena;
 
-    bool slice_outstanding;
-    bool close_queued;
+    // Block backing rx_buf, tx_buf and the arena, freed on close if owned.
+    // Pooled links hold one only while data is buffered.
+    void *mem;
+    bool owns_mem;
+    wen_buffer_pool *pool;
+
+    // Place in the waiters of [pool] while no block was free for the link.
+    struct wen_link *pool_next;
+    struct wen_link *pool_prev;
+    bool pool_waiting;
+
+    // Bytes currently charged to budget.
+    wen_budget *budget;
+    unsigned long charged;
+
+    // Table mirroring the hot fields of this link, see wen_link_table.
+    struct wen_link_table *table;
+    unsigned table_index;
+
+    // Reactor this link is registered with, see wen_loop. Queued links with
+    // work left are chained through loop_prev and loop_next.
+    struct wen_loop *loop;
+    struct wen_link *loop_prev;
+    struct wen_link *loop_next;
+    int loop_fd;
+    bool loop_queued;
+
+    // Bytes the link may still deliver, negative after an oversized batch.
+    long loop_deficit;
+
+    // Deadlines in milliseconds (0 for none), see wen_link_set_timeouts().
+    // Times are on the clock of the wheel the link is in.
+    struct wen_timers *timers;
+    wen_timer timer;
+    unsigned long handshake_timeout;
+    unsigned long idle_timeout;
+    unsigned long ping_interval;
+    unsigned long long started;
+    unsigned long long last_rx;
+    unsigned long long last_ping;
+
+    // Callbacks events are dispatched to, see wen_link_set_handlers().
+    // dispatching is set inside wen_dispatch() and in_handler while a callback
+    // runs; events produced meanwhile are queued.
+    const struct wen_handlers *handlers;
+    bool dispatching;
+    bool in_handler;
+    unsigned long dispatched;
+
+    wen_event_queue evq;
+    wen_tx_ref tx_refs[WEN_TX_REFS];
+    wen_slice_slot slices[WEN_MAX_OUTSTANDING];
 } wen_link;
 
+// Per-link event callbacks, see wen_link_set_handlers().
+//
+// Any of them may be NULL. Events without a dedicated callback go to
+// on_event(); slices nobody takes are released right away.
+typedef struct wen_handlers {
+    void (*on_open)(wen_link *link);
+    void (*on_slice)(wen_link *link, wen_slice slice);
+    void (*on_error)(wen_link *link, wen_result error);
+    void (*on_timeout)(wen_link *link, wen_timeout kind);
+
+    // The last callback for the link; it may free the link.
+    void (*on_close)(wen_link *link);
+
+    void (*on_event)(wen_link *link, const wen_event *ev);
+} wen_handlers;
+
+// A preallocated, contiguous set of links and their buffers.
+//
+// Links are handed out by wen_link_pool_acquire() and reset with
+// wen_link_reuse(), so accepting a connection costs neither a malloc nor a
+// memset of the whole link.
+typedef struct {
+    wen_link *links;
+    wen_link **free;
+    unsigned count;
+    unsigned available;
+
+    // Buffer bytes behind each link, 0 when they come from a buffer pool.
+    unsigned long block_size;
+
+    void *mem;
+    bool owns_memory;
+} wen_link_pool;
+
+// Summary bits kept per link in a wen_link_table.
+typedef enum {
+    // Received bytes are buffered.
+    WEN_LINK_F_RX_PENDING = 1 << 0,
+    // Output is waiting to be written.
+    WEN_LINK_F_TX_PENDING = 1 << 1,
+    // The last write reported WEN_IO_WOULD_BLOCK.
+    WEN_LINK_F_TX_BLOCKED = 1 << 2,
+    // Events are queued.
+    WEN_LINK_F_EVENTS = 1 << 3,
+    // Slices are outstanding.
+    WEN_LINK_F_SLICES = 1 << 4
+} wen_link_flag;
+
+// Hot per-link state of many links in parallel arrays.
+//
+// Sweeps for timeouts, pending output or readiness stream through a few
+// contiguous arrays instead of touching every wen_link. The table mirrors the
+// links: every wen_poll(), wen_poll_batch(), wen_send(), wen_send_ref(),
+// wen_close() and wen_release() on a link in the table refreshes its entry.
+// Deadlines are owned by the table and use the caller's clock; 0 means none.
+typedef struct wen_link_table {
+    wen_link **links;
+    unsigned char *state;
+    unsigned char *flags;
+    unsigned long *rx_len;
+    unsigned long *tx_len;
+    unsigned long *deadline;
+
+    unsigned count;
+    unsigned cap;
+
+    void *mem;
+    bool owns_memory;
+} wen_link_table;
+
+// A file descriptor watched by a wen_loop next to its links, e.g. a listening
+// socket. Owned by the caller and reported for as long as it is readable.
+typedef struct {
+    int fd;
+    void *user;
+} wen_loop_watch;
+
+// An event delivered by wen_loop_run().
+//
+// [ev] came from [link], or [link] is NULL and [watch] became readable.
+typedef struct {
+    wen_link *link;
+    wen_loop_watch *watch;
+    wen_event ev;
+} wen_loop_event;
+
+// Where a wen_loop spent its waits, see wen_loop_set_spin().
+typedef struct wen_loop_stats {
+    unsigned long long spin_us;
+    unsigned long long sleep_us;
+
+    // Waits ended by activity found while spinning, and waits that blocked.
+    unsigned long spin_wakeups;
+    unsigned long sleeps;
+} wen_loop_stats;
+
+// Readiness-driven reactor for many links.
+//
+// Links are registered together with their non-blocking socket and are only
+// polled once epoll reports it readable or writable, or once the link has
+// queued events or fresh output of its own. Linux only; elsewhere
+// wen_loop_init() returns WEN_ERR_UNSUPPORTED. Like links, a loop must be
+// confined to a single thread.
+typedef struct wen_loop {
+    int fd;
+    unsigned count;
+
+    // Links with work to do, oldest first.
+    wen_link *ready_head;
+    wen_link *ready_tail;
+    unsigned ready_count;
+
+    // Link being polled by wen_loop_run(), which requeues it itself.
+    wen_link *current;
+
+    // Events and bytes a link gets per round, see wen_loop_set_quantum().
+    unsigned quantum;
+    unsigned long quantum_bytes;
+
+    // Busy polling window after the last event, see wen_loop_set_spin().
+    unsigned long spin_us;
+    unsigned long long last_active;
+    wen_loop_stats stats;
+
+    // Wheel advanced on every wen_loop_run(), see wen_loop_set_timers().
+    wen_timers *timers;
+
+    // Ring the loop waits on instead of epoll, see wen_loop_init_uring(). The
+    // epoll instance is then itself polled through the ring.
+    struct wen_uring *uring;
+    bool uring_polling;
+    bool uring_epoll;
+} wen_loop;
+
+// An io_uring instance shared by many links.
+//
+// Reads are multishot receives into a ring of kernel-provided buffers and
+// writes are copied into a send buffer per connection, so the kernel never
+// touches link memory. A wen_loop driven by the ring submits and reaps the
+// I/O of all its links with a single io_uring_enter() per wen_loop_run().
+// Linux 6.0 or later; elsewhere wen_uring_init() returns WEN_ERR_UNSUPPORTED.
+typedef struct wen_uring {
+    int fd;
+
+    // Submission and completion rings shared with the kernel.
+    void *rings;
+    unsigned long rings_size;
+    void *sqes;
+    unsigned long sqes_size;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_array;
+    unsigned sq_mask;
+    unsigned sq_pending;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    void *cqes;
+    unsigned cq_mask;
+
+    // One mapping holding the provided buffer ring, [buffers] receive buffers,
+    // [buffers] send buffers and the bookkeeping below.
+    void *mem;
+    unsigned long mem_size;
+    void *buf_ring;
+    unsigned char *slab;
+    unsigned long buffer_size;
+    unsigned buffers;
+    unsigned short buf_tail;
+
+    // Received length and next buffer id of every receive buffer a connection holds.
+    unsigned *buf_len;
+    unsigned *buf_next;
+
+    // Send buffers not owned by any connection.
+    unsigned *send_free;
+    unsigned send_available;
+} wen_uring;
+
+typedef struct wen_shard wen_shard;
+
+// Configuration of a wen_runtime.
+typedef struct {
+    // Number of shards, 0 for one per online CPU.
+    unsigned shards;
+
+    // Numeric IPv4 or IPv6 address to listen on, NULL for any IPv4 address.
+    // Port 0 picks one port shared by all shards, see wen_runtime.port.
+    const char *host;
+    unsigned short port;
+    int backlog;
+
+    // Pins shard i to the i-th CPU the process may run on, modulo their
+    // number; see wen_shard.cpu. Needs _GNU_SOURCE defined before the first
+    // #include; without it wen_runtime_start() returns WEN_ERR_UNSUPPORTED.
+    bool pin;
+
+    // Resolution of the timer wheel of every shard, 0 for WEN_TIMER_TICK_MS.
+    unsigned long timer_tick_ms;
+
+    // Busy polling window of every shard loop, see wen_loop_set_spin().
+    unsigned long spin_us;
+
+    // Called on the thread of [shard]. on_accept() gets a non-blocking socket
+    // and either adds a link for it to shard->loop or closes it. on_event()
+    // gets every other event of the loop. on_stop() must remove the links
+    // still in the loop.
+    void (*on_start)(wen_shard *shard);
+    void (*on_accept)(wen_shard *shard, int fd);
+    void (*on_event)(wen_shard *shard, wen_loop_event *ev);
+    void (*on_stop)(wen_shard *shard);
+    void *user;
+} wen_runtime_config;
+
+// One thread of a wen_runtime with the loop and listener it owns.
+struct wen_shard {
+    unsigned index;
+
+    // CPU the thread of the shard is pinned to, -1 if it is not pinned
+    // because pinning was not asked for or failed. Final by on_start().
+    int cpu;
+    wen_loop loop;
+    wen_timers timers;
+    wen_loop_watch listener;
+    wen_loop_watch wakeup;
+    struct wen_runtime *runtime;
+
+    // Free for the application, e.g. per-shard pools and link tables.
+    void *user;
+};
+
+// Thread-per-core server runtime.
+//
+// Each shard runs its own wen_loop on its own thread and accepts on its own
+// SO_REUSEPORT listener, so the kernel spreads connections over the shards
+// and nothing is shared or locked while serving them. A link stays on the
+// shard that accepted it. Linux only; elsewhere wen_runtime_start() returns
+// WEN_ERR_UNSUPPORTED.
+typedef struct wen_runtime {
+    wen_runtime_config config;
+    unsigned short port;
+
+    wen_shard *shards;
+    unsigned count;
+    void *threads;
+    unsigned started;
+    int stopping;
+} wen_runtime;
+
+// A socket whose I/O goes through a wen_uring, see wen_uring_conn_init().
+typedef struct {
+    wen_uring *ring;
+    wen_link *link;
+    int fd;
+
+    // Operations the kernel still holds this connection for.
+    unsigned inflight;
+    bool closing;
+
+    // Received buffers not read yet, oldest first; rx_off bytes of the first
+    // one are. After them the stream ends with rx_result if rx_done is set.
+    unsigned rx_head;
+    unsigned rx_tail;
+    unsigned long rx_off;
+    bool rx_armed;
+    bool rx_done;
+    long rx_result;
+
+    // Send buffer; bytes tx_off up to tx_len are still to be sent.
+    unsigned tx_buf;
+    unsigned long tx_off;
+    unsigned long tx_len;
+    bool tx_busy;
+    bool tx_error;
+} wen_uring_conn;
+
 // WebSocket protocol GUID used during the handshake.
 #ifdef WEN_ENABLE_WS
 #    define WEN_WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
@@ -350,35 +1075,288 @@ typedef struct wen_link {
 #endif // WEN_ENABLE_WS
 
 // Initializes a link with the given IO backend.
+//
+// Uses the default buffer sizes. With WEN_NO_MALLOC use wen_link_init_ex() and
+// provide the memory.
 WENDEF wen_result wen_link_init(wen_link *link, wen_io io);
 
+// Initializes a link with per-link buffer sizes or caller-provided memory.
+//
+// [config] may be NULL for the defaults. Returns WEN_ERR_STATE for buffers
+// smaller than WEN_MIN_BUFFER, WEN_ERR_OVERFLOW if [config->mem] is too small
+// and WEN_ERR_BUDGET if [config->budget] cannot cover the buffers.
+WENDEF wen_result wen_link_init_ex(wen_link *link, wen_io io, const wen_link_config *config);
+
+// Returns the number of bytes wen_link_init_ex() needs for [config].
+WENDEF unsigned long wen_link_mem_size(const wen_link_config *config);
+
+// Frees the link buffers if wen allocated them, or returns them to their pool,
+// and takes the link off its timer wheel.
+//
+// Happens on its own once WEN_EV_CLOSE is polled; only needed for links that
+// are dropped before that. Caller-provided memory stays attached on close so
+// the link can be restarted with wen_link_reuse().
+WENDEF void wen_link_deinit(wen_link *link);
+
+// Restarts a link on a new transport, keeping its buffers and arena.
+//
+// Only the control fields are reset. The link must still hold its memory
+// (caller-provided, or not closed yet) or use a buffer pool.
+WENDEF wen_result wen_link_reuse(wen_link *link, wen_io io);
+
+// Returns the number of bytes wen_link_pool_bind() needs for [count] links.
+WENDEF unsigned long wen_link_pool_mem_size(const wen_link_config *config, unsigned count);
+
+// Allocates a pool of [count] links with buffers sized by [config].
+//
+// With [config->pool] set the links borrow their buffers from that buffer
+// pool instead.
+WENDEF wen_result wen_link_pool_init(wen_link_pool *pool, const wen_link_config *config, unsigned count);
+
+// Builds a pool of [count] links out of [size] bytes of caller-owned [mem].
+//
+// [mem] must be aligned for wen_link and hold wen_link_pool_mem_size() bytes.
+WENDEF wen_result wen_link_pool_bind(wen_link_pool *pool, const wen_link_config *config, unsigned count,
+                                     void *mem, unsigned long size);
+
+// Frees the pool memory if wen allocated it.
+WENDEF void wen_link_pool_free(wen_link_pool *pool);
+
+// Takes a link out of the pool and readies it for [io].
+//
+// Returns NULL when every link is in use or its buffers do not fit the budget.
+WENDEF wen_link *wen_link_pool_acquire(wen_link_pool *pool, wen_io io);
+
+// Puts a link back into the pool.
+WENDEF void wen_link_pool_release(wen_link_pool *pool, wen_link *link);
+
+// Sets up a budget of [limit] bytes, 0 for no limit.
+WENDEF void wen_budget_init(wen_budget *budget, unsigned long limit);
+
+// Accounts [size] more bytes against the budget.
+//
+// Returns WEN_ERR_BUDGET, leaving the budget untouched, if that would exceed the limit.
+WENDEF wen_result wen_budget_charge(wen_budget *budget, unsigned long size);
+
+// Gives back [size] bytes previously charged.
+WENDEF void wen_budget_release(wen_budget *budget, unsigned long size);
+
+// Returns the number of bytes wen_link_table_bind() needs for [cap] links.
+WENDEF unsigned long wen_link_table_mem_size(unsigned cap);
+
+// Allocates a table for up to [cap] links.
+WENDEF wen_result wen_link_table_init(wen_link_table *table, unsigned cap);
+
+// Builds a table for up to [cap] links out of [size] bytes of caller-owned [mem].
+WENDEF wen_result wen_link_table_bind(wen_link_table *table, unsigned cap, void *mem, unsigned long size);
+
+// Frees the table memory if wen allocated it and detaches all its links.
+WENDEF void wen_link_table_free(wen_link_table *table);
+
+// Adds [link] to the table. Its index is available as link->table_index.
+//
+// Returns WEN_ERR_OVERFLOW when the table is full.
+WENDEF wen_result wen_link_table_add(wen_link_table *table, wen_link *link);
+
+// Removes [link] from the table.
+//
+// The last entry moves into its slot, so indices of other links may change.
+WENDEF void wen_link_table_remove(wen_link_table *table, wen_link *link);
+
+// Sets the deadline of [link], 0 for none.
+WENDEF void wen_link_table_set_deadline(wen_link_table *table, wen_link *link, unsigned long deadline);
+
+// Stores in [out] up to [cap] links whose deadline is set and not after [now].
+//
+// Returns the number of links stored.
+WENDEF unsigned wen_link_table_expired(const wen_link_table *table, unsigned long now,
+                                       wen_link **out, unsigned cap);
+
+// Stores in [out] up to [cap] links with any of the wen_link_flag bits in [mask].
+//
+// Returns the number of links stored.
+WENDEF unsigned wen_link_table_find(const wen_link_table *table, unsigned mask, wen_link **out, unsigned cap);
+
+// Refreshes the table entry of [link], if it is in a table.
+WENDEF void wen__link_sync(wen_link *link);
+
+// Returns true if the link currently holds its buffers.
+//
+// Always true for links that are not pooled, until they close.
+WENDEF bool wen_link_has_buffers(const wen_link *link);
+
+// Allocates a pool of [count] blocks sized by [config].
+WENDEF wen_result wen_buffer_pool_init(wen_buffer_pool *pool, const wen_link_config *config, unsigned count);
+
+// Builds a pool out of [size] bytes of caller-owned [mem].
+//
+// Holds as many blocks of wen_link_mem_size(config) bytes as fit.
+WENDEF wen_result wen_buffer_pool_bind(wen_buffer_pool *pool, const wen_link_config *config,
+                                       void *mem, unsigned long size);
+
+// Frees the pool memory if wen allocated it.
+//
+// Every link using the pool must be closed or deinitialized first.
+WENDEF void wen_buffer_pool_free(wen_buffer_pool *pool);
+
+// Returns the number of blocks not lent to any link.
+WENDEF unsigned wen_buffer_pool_available(const wen_buffer_pool *pool);
+
 // Attaches a codec to the link.
 //
 // Must be called before polling.
 WENDEF void wen_link_attach_codec(wen_link *link, const wen_codec *codec, void *codec_state);
 
+// Selects whether slices are copied into the arena or served from rx_buf.
+//
+// Must not be called while a slice is outstanding.
+WENDEF wen_result wen_link_set_slice_mode(wen_link *link, wen_slice_mode mode);
+
+// Sets how many slices the link may hand out before they are released.
+//
+// Defaults to 1. Slices may be released in any order. Once the limit is
+// reached no further slices are produced and incoming data stays buffered.
+WENDEF wen_result wen_link_set_slice_limit(wen_link *link, unsigned limit);
+
+// Enables drain mode for edge-triggered readiness.
+//
+// Each poll keeps reading, and decoding into the event queue to make room,
+// until a read comes back short, [max_reads] reads were made or at least
+// [max_bytes] bytes were read (0 for no byte limit). [max_reads] of 0 restores
+// the default of a single read per poll.
+WENDEF void wen_link_set_drain(wen_link *link, unsigned max_reads, unsigned long max_bytes);
+
+// Returns true if the last poll read until the transport ran dry or reported
+// WEN_IO_WOULD_BLOCK.
+//
+// When false in drain mode the budget ran out first, and the link has to be
+// polled again without waiting for another readiness notification.
+WENDEF bool wen_link_rx_drained(const wen_link *link);
+
+// Returns the number of slices handed out and not yet released.
+WENDEF unsigned wen_link_slices_outstanding(const wen_link *link);
+
 // Polls for the next available event.
 //
 // Returns true if an event was produced.
-// When WEN_NO_MALLOC is enabled, the user must call wen_arena_bind() before polling.
 WENDEF bool wen_poll(wen_link *link, wen_event *ev);
 
+// Polls for up to [cap] events at once.
+//
+// Queued events and already buffered frames are drained first, then one round
+// of I/O is performed and as many of the newly read frames as fit are decoded.
+// Returns the number of events stored in [out].
+WENDEF unsigned wen_poll_batch(wen_link *link, wen_event *out, unsigned cap);
+
+// Like wen_poll(), and stores in [interest] the wen_interest bits telling
+// what the link waits for now. If [next_ms] is not NULL, it receives
+// wen_link_next_deadline().
+//
+// With no bits set the link is closed and drained. Buffered frames held back
+// by the slice limit do not count; poll again after wen_release().
+WENDEF bool wen_poll_interest(wen_link *link, wen_event *ev, unsigned *interest, long *next_ms);
+
+// Returns the milliseconds until the next deadline of [link] on its wheel,
+// 0 if one is due, or -1 if it has none.
+WENDEF long wen_link_next_deadline(const wen_link *link);
+
+WENDEF unsigned wen__link_interest(const wen_link *link, bool produced);
+
+// Makes [link] deliver its events to [handlers] (NULL to go back to polling
+// for them), which must stay valid while set.
+//
+// Slices decoded by wen_dispatch() while no callback is running are handed to
+// on_slice() straight from the decoder, without going through the event
+// queue; wen_poll() still returns them as events. Events
+// that arise inside a callback, e.g. from a nested wen_dispatch(), are
+// queued and dispatched once it returns.
+WENDEF void wen_link_set_handlers(wen_link *link, const wen_handlers *handlers);
+
+// Polls [link] like wen_poll_batch() and dispatches up to [max] events to
+// its handlers. Returns the number of events dispatched, 0 if called from a
+// callback of the same link.
+//
+// Once on_close() has run the link is not touched again.
+WENDEF unsigned wen_dispatch(wen_link *link, unsigned max);
+
+WENDEF unsigned wen__dispatch_drain(wen_link *link, unsigned n, unsigned max, bool *closed);
+WENDEF bool wen__dispatch_event(wen_link *link, const wen_event *ev);
+WENDEF unsigned long long wen__link_deadline(const wen_link *link);
+
+WENDEF bool wen__poll_once(wen_link *link, wen_event *ev);
+WENDEF unsigned wen__poll_batch(wen_link *link, wen_event *out, unsigned cap);
+WENDEF unsigned wen__poll_drain(wen_link *link, wen_event *out, unsigned n, unsigned cap);
+WENDEF bool wen__poll_pop(wen_link *link, wen_event *ev);
+WENDEF unsigned wen__poll_io(wen_link *link, wen_event *ev);
 WENDEF unsigned wen__poll_flush_tx(wen_link *link, wen_event *ev);
 WENDEF unsigned wen__poll_read_rx(wen_link *link, wen_event *ev);
+WENDEF unsigned long wen__rx_room(const wen_link *link, unsigned long *end, unsigned long *front);
+WENDEF unsigned wen__rx_decode_ahead(wen_link *link, wen_event *ev);
 WENDEF bool wen__poll_handshake(wen_link *link, wen_event *ev);
 WENDEF bool wen__poll_decode(wen_link *link, wen_event *ev);
+WENDEF unsigned long wen__rx_span(const wen_link *link);
+WENDEF void wen__rx_consume(wen_link *link, unsigned long n);
+WENDEF void wen__rx_compact(wen_link *link);
+WENDEF void wen__rx_linearize(wen_link *link);
+WENDEF void wen__reverse(unsigned char *p, unsigned long n);
+WENDEF unsigned long wen__tx_span(const wen_link *link);
+WENDEF void wen__tx_consume(wen_link *link, unsigned long n);
+WENDEF unsigned char *wen__tx_tail(wen_link *link, unsigned long *room);
+WENDEF wen_result wen__tx_encode_into(wen_link *link, unsigned opcode, const void *data, unsigned long len,
+                                      bool header_only, void *out, unsigned long out_cap,
+                                      unsigned long *out_len);
+WENDEF wen_result wen__tx_encode(wen_link *link, unsigned opcode, const void *data, unsigned long len,
+                                 bool header_only);
+WENDEF unsigned wen__tx_iov(wen_link *link, unsigned long pos, unsigned long count,
+                            wen_iovec *iov, unsigned max);
+WENDEF unsigned wen__tx_gather(wen_link *link, wen_iovec *iov, unsigned max);
+WENDEF void wen__tx_advance(wen_link *link, unsigned long n);
 
 // Releases a slice previously returned by wen_poll().
 WENDEF void wen_release(wen_link *link, wen_slice slice);
 
+// Allocates [size] bytes of scratch memory for handling [slice].
+//
+// The memory comes from the link arena and is rolled back together with the
+// slice by wen_release(), so it must not be used after that. Returns NULL if
+// the slice is not outstanding or the arena is full.
+WENDEF void *wen_slice_alloc(wen_link *link, wen_slice slice, unsigned long size);
+
+WENDEF bool wen__slice_live(const wen_link *link, unsigned handle);
+
+// Returns true if the last write attempt reported WEN_IO_WOULD_BLOCK.
+//
+// The backlog is retried on the next poll, once the transport is writable.
+WENDEF bool wen_link_tx_blocked(const wen_link *link);
+
 // Sends an application message using the active codec.
 WENDEF wen_result wen_send(wen_link *link, unsigned opcode, const void *data, unsigned long len);
 
+// Sends an application message without copying its payload.
+//
+// Only the frame header is encoded into the transmit buffer. The payload is
+// written straight from [data], which must stay valid and unmodified until a
+// WEN_EV_SENT event carrying [data] and [user] is returned by wen_poll().
+// Payloads still queued when the link closes are never reported.
+// Requires a codec that implements encode_header().
+WENDEF wen_result wen_send_ref(wen_link *link, unsigned opcode, const void *data, unsigned long len,
+                               void *user);
+
 // Initiates a clean protocol-level close.
 WENDEF wen_result wen_close(wen_link *link, unsigned code, unsigned opcode);
 
 // Clears internal RX and TX buffer lengths without touching memory
 WENDEF void wen_link_reset_buffers(wen_link *link);
+WENDEF void wen__link_config(const wen_link_config *config, wen_link_config *out);
+WENDEF void wen__link_carve(wen_link *link, unsigned char *mem, const wen_link_config *config);
+WENDEF wen_result wen__link_attach(wen_link *link);
+WENDEF wen_result wen__link_charge(wen_link *link, unsigned long size);
+WENDEF void wen__link_uncharge(wen_link *link);
+WENDEF void wen__link_detach_idle(wen_link *link);
+WENDEF void wen__link_free_mem(wen_link *link);
+WENDEF void wen__pool_wait(wen_link *link);
+WENDEF void wen__pool_unwait(wen_link *link);
+WENDEF void wen__pool_wake(wen_buffer_pool *pool);
 
 // Pushes an event onto the event queue.
 //
@@ -390,18 +1368,24 @@ WENDEF bool wen_evq_push(wen_event_queue *q, const wen_event *ev);
 // Returns true if an event was returned, false if the queue is empty.
 WENDEF bool wen_evq_pop(wen_event_queue *q, wen_event *ev);
 
+// Returns the number of events in the queue.
+WENDEF unsigned wen_evq_len(const wen_event_queue *q);
+
 #define WEN_STATIC_ASSERT(cond, name) typedef char wen_static_assert_##name[(cond) ? 1 : -1]
 
 WEN_STATIC_ASSERT(WEN_RX_BUFFER >= 1024, rx_buffer_too_small);
 WEN_STATIC_ASSERT(WEN_TX_BUFFER >= 1024, tx_buffer_too_small);
+WEN_STATIC_ASSERT((WEN_MAX_OUTSTANDING & (WEN_MAX_OUTSTANDING - 1)) == 0, max_outstanding_not_pow2);
 
 //////////////////////////////////////////////////////////////////////////////
 
-// Returns the number of bytes remaining in the arena.
-#define WEN_ARENA_REMAINING(a) ((a)->capacity - (a)->used)
+// Returns the number of bytes remaining in the block the arena bumps from:
+// its base block, or the newest page of a chained arena.
+#define WEN_ARENA_REMAINING(a) wen_arena_remaining(a)
 
-// Returns non-zero if the arena has at least [n] bytes available.
-#define WEN_ARENA_CAN_ALLOC(a, n) ((a)->used + (n) <= (a)->capacity)
+// Returns non-zero if the arena can allocate [n] bytes, in the current block
+// or in a fresh page from its pool.
+#define WEN_ARENA_CAN_ALLOC(a, n) wen_arena_can_alloc((a), (n))
 
 // Aligns [x] up to the next multiple of [a].
 #define WEN_ALIGN_UP(x, a) (((x) + ((a) - 1)) & ~((a) - 1))
@@ -419,6 +1403,9 @@ WENDEF void wen_arena_reset(wen_arena *a, wen_arena_snapshot snapshot);
 // Allocates [size] bytes to arena memory.
 WENDEF wen_result wen_arena_init(wen_arena *arena, unsigned long size);
 
+// Uses [size] bytes of caller-owned [mem] as arena memory.
+WENDEF void wen_arena_bind(wen_arena *arena, void *mem, unsigned long size);
+
 // Allocates [size] bytes from the arena.
 //
 // The returned memory is uninitialized.
@@ -430,365 +1417,3522 @@ WENDEF void *wen_arena_alloc(wen_arena *a, unsigned long size);
 // The returned memory is zero-initialized.
 WENDEF void *wen_arena_calloc(wen_arena *a, unsigned long count, unsigned long size);
 
-#ifdef WEN_IMPLEMENTATION
+// See WEN_ARENA_REMAINING() and WEN_ARENA_CAN_ALLOC().
+WENDEF unsigned long wen_arena_remaining(const wen_arena *a);
+WENDEF bool wen_arena_can_alloc(const wen_arena *a, unsigned long size);
 
-WENDEF void wen_link_reset_buffers(wen_link *link)
-{
-    link->rx_len = 0;
-    link->tx_len = 0;
-}
+// Lets the arena chain pages from [pages] once its base block is full.
+//
+// A single allocation still has to fit into one page.
+WENDEF void wen_arena_chain(wen_arena *arena, wen_page_pool *pages);
 
-WENDEF wen_result wen_link_init(wen_link *link, wen_io io) {
-    if (!link || !io.read || !io.write) return WEN_ERR_STATE;
+// Allocates a pool of [count] pages of [page_size] bytes.
+WENDEF wen_result wen_page_pool_init(wen_page_pool *pool, unsigned long page_size, unsigned count);
 
-    WEN_ASSERT(io.read != NULL && io.write != NULL);
+// Builds a page pool out of [size] bytes of caller-owned [mem].
+WENDEF wen_result wen_page_pool_bind(wen_page_pool *pool, unsigned long page_size, void *mem, unsigned long size);
 
-    memset(link, 0, sizeof(*link));
+// Frees the pool memory if wen allocated it.
+//
+// Every arena chaining from the pool must be reset to 0 first.
+WENDEF void wen_page_pool_free(wen_page_pool *pool);
 
-    link->state = WEN_LINK_INIT;
-    link->io    = io;
+// Returns the number of pages not chained to any arena.
+WENDEF unsigned wen_page_pool_available(const wen_page_pool *pool);
 
-    unsigned long arena_size = WEN_RX_BUFFER + WEN_TX_BUFFER;
-    wen_result result = wen_arena_init(&link->arena, arena_size);
-    if (result != WEN_OK) return result;
+// Returns the usable bytes of a page, after its header.
+WENDEF unsigned long wen__page_capacity(const wen_page_pool *pool);
 
-    wen_link_reset_buffers(link);
-    wen_arena_reset(&link->arena, 0);
+// Returns the logical offset at which the current block of [a] ends.
+WENDEF unsigned long wen__arena_end(const wen_arena *a);
 
-    return WEN_OK;
-}
+// Maps an anonymous region of at least [size] bytes.
+//
+// [flags] is a mask of wen_region_flags. Huge pages fall back to normal pages
+// when the system has none to give. Returns WEN_ERR_UNSUPPORTED where mmap is
+// not available and WEN_ERR_IO if mapping or locking fails.
+WENDEF wen_result wen_region_map(wen_region *region, unsigned long size, unsigned flags);
 
-WENDEF void wen_link_attach_codec(wen_link *link, const wen_codec *codec, void *codec_state)
-{
-    if (!link || !codec) return;
-    WEN_ASSERT(codec->handshake && "codec must provide handshake()");
+// Carves [size] bytes out of the region, e.g. for wen_link_pool_bind(),
+// wen_buffer_pool_bind() or wen_link_init_ex().
+//
+// Returns NULL if the region is full.
+WENDEF void *wen_region_alloc(wen_region *region, unsigned long size);
 
-    link->codec       = codec;
-    link->codec_state = codec_state;
-    link->state       = WEN_LINK_HANDSHAKE;
-}
+// Unmaps the region, invalidating everything carved out of it.
+WENDEF void wen_region_unmap(wen_region *region);
 
-WENDEF bool wen_poll(wen_link *link, wen_event *ev)
-{
-    if (!link || !ev) return false;
+// Creates the epoll instance behind a loop.
+WENDEF wen_result wen_loop_init(wen_loop *loop);
 
-    // The event queue has priority.
-    // If something was already generated on a previous call, return it before doing any I/O.
-    if (wen_evq_pop(&link->evq, ev)) {
-        if (ev->type == WEN_EV_CLOSE && link->state != WEN_LINK_CLOSED) {
-            link->state = WEN_LINK_CLOSED;
-            link->close_queued = false;
+// Closes the loop. Every link and watch must be removed first.
+WENDEF void wen_loop_free(wen_loop *loop);
 
-#ifndef WEN_NO_MALLOC
-            if (link->arena.owns_memory && link->arena.base)
-                free(link->arena.base);
-#endif
+// Registers [link] with its non-blocking socket [fd].
+//
+// The transport of the link must report WEN_IO_WOULD_BLOCK instead of
+// blocking. Unless already set, drain mode is enabled with
+// WEN_LOOP_DRAIN_READS reads per poll. A link belongs to at most one loop.
+WENDEF wen_result wen_loop_add(wen_loop *loop, wen_link *link, int fd);
 
-            link->arena.base = NULL;
-        }
-        return true;
-    }
+// Unregisters [link]. Happens on its own once its WEN_EV_CLOSE is delivered.
+WENDEF void wen_loop_remove(wen_loop *loop, wen_link *link);
 
-    if (link->state == WEN_LINK_CLOSED) return false;
+// Reports [watch] from wen_loop_run() whenever its descriptor is readable.
+WENDEF wen_result wen_loop_add_watch(wen_loop *loop, wen_loop_watch *watch);
 
-    if (!link->codec) {
-        ev->type = WEN_EV_ERROR;
-        ev->as.error = WEN_ERR_UNSUPPORTED;
-        return true;
-    }
+WENDEF void wen_loop_remove_watch(wen_loop *loop, wen_loop_watch *watch);
 
-    // Flush pending TX
-    unsigned tx_err = wen__poll_flush_tx(link, ev);
-    if (tx_err != (unsigned)-1) return tx_err;
+// Waits up to [timeout_ms] (-1 for no limit) for readiness, then polls every
+// ready link once and stores up to [cap] events in [out].
+//
+// Does not wait while links still have work left over from an earlier call,
+// e.g. because [out] filled up. Returns the number of events stored.
+WENDEF unsigned wen_loop_run(wen_loop *loop, wen_loop_event *out, unsigned cap, int timeout_ms);
 
-    // Single RX read
-    unsigned rx_err = wen__poll_read_rx(link, ev);
-    if (rx_err != (unsigned)-1) return rx_err;
+// Sets how much a ready link may deliver per wen_loop_run(): at most
+// [events] events (0 for WEN_LOOP_BATCH), and [bytes] of slices per round
+// on average (0 for no limit).
+//
+// The byte budget is a deficit round robin: a link that overran it with one
+// batch sits out rounds until its debt is paid, and it also bounds how much
+// is read from the socket per poll. Defaults to WEN_LOOP_QUANTUM and
+// WEN_LOOP_QUANTUM_BYTES.
+WENDEF void wen_loop_set_quantum(wen_loop *loop, unsigned events, unsigned long bytes);
+
+// Makes wen_loop_run() busy poll instead of sleeping for up to [spin_us]
+// microseconds after it last returned events (0, the default, to always
+// sleep).
+//
+// Bursts are then picked up without a wakeup, at the cost of a core while
+// the window lasts. Once it closes, the loop sleeps as usual. Time spent
+// both ways is added up in loop->stats.
+WENDEF void wen_loop_set_spin(wen_loop *loop, unsigned long spin_us);
+
+// Sets up a ring with [entries] submission slots (0 for WEN_URING_ENTRIES)
+// and [buffers] receive and send buffers of [buffer_size] bytes each (0 for
+// WEN_URING_BUFFER).
+//
+// [buffers] must be a power of two up to 32768 and bounds the number of
+// connections. Returns WEN_ERR_UNSUPPORTED if the kernel lacks io_uring or
+// provided buffer rings.
+WENDEF wen_result wen_uring_init(wen_uring *ring, unsigned entries, unsigned buffers,
+                                 unsigned long buffer_size);
 
-    if (link->state == WEN_LINK_HANDSHAKE) 
-        return wen__poll_handshake(link, ev);
+// Tears the ring down. Every connection must be closed first.
+WENDEF void wen_uring_free(wen_uring *ring);
+
+// Binds [conn] to the non-blocking socket [fd] and stores the matching
+// transport in [io], ready for wen_link_init().
+//
+// The transport only queues I/O on the ring; it progresses on wen_loop_run()
+// of a loop set up with wen_loop_init_uring() on the same ring, or on
+// wen_uring_run(). Returns WEN_ERR_OVERFLOW when every send buffer is taken.
+WENDEF wen_result wen_uring_conn_init(wen_uring_conn *conn, wen_uring *ring, int fd, wen_io *io);
+
+// Cancels the I/O of [conn] and waits for the kernel to let go of it. Call it
+// before closing the socket or freeing [conn].
+WENDEF void wen_uring_conn_close(wen_uring_conn *conn);
+
+// Submits the I/O queued on [ring] and reaps its completions, waiting up to
+// [timeout_ms] for one (0 to not wait, -1 forever).
+//
+// Drives ring connections whose links are polled with wen_poll() rather than
+// through a wen_loop. Returns the number of completions reaped, or -1 on error.
+WENDEF long wen_uring_run(wen_uring *ring, int timeout_ms);
+
+// Like wen_loop_init(), but waits on [ring]. Links whose transport comes from
+// wen_uring_conn_init() are driven by their completions; other links and
+// watches still go through epoll. wen_loop_add() refuses ring connections
+// on any other loop with WEN_ERR_STATE.
+WENDEF wen_result wen_loop_init_uring(wen_loop *loop, wen_uring *ring);
+
+// Starts an empty wheel at time [now] ticking every [tick_ms] milliseconds
+// (0 for WEN_TIMER_TICK_MS).
+WENDEF void wen_timers_init(wen_timers *timers, unsigned long tick_ms, unsigned long long now);
+
+// Sets the deadlines of [link] in milliseconds, 0 disabling one.
+//
+// [handshake_ms] counts from wen_timers_add(), [idle_ms] from the last byte
+// received and [ping_ms] from the previous ping deadline. Each expired
+// deadline queues a WEN_EV_TIMEOUT event; idle and ping deadlines recur.
+WENDEF void wen_link_set_timeouts(wen_link *link, unsigned long handshake_ms, unsigned long idle_ms,
+                                  unsigned long ping_ms);
+
+// Schedules the deadlines of [link] on [timers], counting from the current time.
+//
+// Links leave the wheel on their own once WEN_EV_CLOSE is polled.
+WENDEF void wen_timers_add(wen_timers *timers, wen_link *link);
+
+WENDEF void wen_timers_remove(wen_link *link);
+
+// Moves the wheel forward to [now] and queues an event on every link with an
+// expired deadline. Returns the number of events queued.
+WENDEF unsigned wen_timers_advance(wen_timers *timers, unsigned long long now);
+
+// Returns the milliseconds until the next slot with deadlines comes up,
+// or -1 if the wheel is empty. May be early, never late.
+WENDEF long wen_timers_next(const wen_timers *timers);
+
+// Bounds the waits of [loop] by the deadlines on [timers] and advances them
+// on every wen_loop_run() using wen_time_ms().
+WENDEF void wen_loop_set_timers(wen_loop *loop, wen_timers *timers);
+
+// Returns a monotonic time in milliseconds.
+WENDEF unsigned long long wen_time_ms(void);
+
+// Returns a monotonic time in microseconds.
+WENDEF unsigned long long wen_time_us(void);
+
+WENDEF void wen__timers_schedule(wen_timers *timers, wen_link *link);
+WENDEF void wen__timers_link(wen_timers *timers, wen_timer *timer);
+WENDEF void wen__timers_unlink(wen_timers *timers, wen_timer *timer);
+WENDEF void wen__timers_cascade(wen_timers *timers, unsigned level);
+WENDEF unsigned wen__timers_fire(wen_timers *timers, wen_link *link);
+WENDEF unsigned wen__ctz64(unsigned long long x);
+
+// Opens the listeners of every shard and starts one thread per shard.
+//
+// Returns WEN_ERR_IO if a listener or thread cannot be set up or, with pin,
+// the CPUs of the process cannot be queried, and WEN_ERR_UNSUPPORTED off Linux
+// or if pinning was asked for but is unavailable.
+WENDEF wen_result wen_runtime_start(wen_runtime *rt, const wen_runtime_config *config);
+
+// Wakes every shard, waits for its thread to finish and closes the listeners.
+WENDEF void wen_runtime_stop(wen_runtime *rt);
+
+WENDEF int wen__runtime_listen(wen_runtime *rt);
+WENDEF void *wen__shard_main(void *arg);
+WENDEF void wen__shard_accept(wen_shard *shard);
+
+WENDEF long wen__uring_read(void *user, void *buf, unsigned long len);
+WENDEF long wen__uring_write(void *user, const void *buf, unsigned long len);
+WENDEF void *wen__uring_sqe(wen_uring *ring);
+WENDEF long wen__uring_enter(wen_uring *ring, unsigned wait, int timeout_ms);
+WENDEF unsigned wen__uring_reap(wen_uring *ring);
+WENDEF void wen__uring_complete(wen_uring *ring, unsigned long long data, int res, unsigned flags);
+WENDEF bool wen__uring_recv(wen_uring_conn *conn);
+WENDEF bool wen__uring_send(wen_uring_conn *conn);
+WENDEF bool wen__uring_cancel(wen_uring *ring, unsigned long long data);
+WENDEF void wen__uring_recycle(wen_uring *ring, unsigned id);
+WENDEF wen_uring_conn *wen__loop_conn(const wen_loop *loop, const wen_link *link);
+WENDEF bool wen__loop_uring_wait(wen_loop *loop, int timeout_ms);
+WENDEF int wen__loop_wait(wen_loop *loop, void *ready, int timeout_ms);
+
+WENDEF void wen__loop_queue(wen_loop *loop, wen_link *link);
+WENDEF void wen__loop_unqueue(wen_loop *loop, wen_link *link);
+WENDEF void wen__loop_touch(wen_loop *loop, wen_link *link);
+
+#ifdef WEN_IMPLEMENTATION
+
+// Header at the start of every page chained to an arena.
+typedef struct {
+    unsigned char *prev;
+    unsigned long prev_start;
+} wen__arena_page;
+
+#define WEN__ARENA_PAGE_HEADER WEN_ALIGN_UP(sizeof(wen__arena_page), WEN_ARENA_ALIGN)
+
+#if defined(__unix__) || defined(__APPLE__)
+#    include <sys/mman.h>
+#    include <unistd.h>
+#    if defined(MAP_ANONYMOUS)
+#        define WEN__MAP_ANON MAP_ANONYMOUS
+#    elif defined(MAP_ANON)
+#        define WEN__MAP_ANON MAP_ANON
+#    endif
+#endif
+
+#include <stddef.h>
+#include <time.h>
+
+// wen_time_us() reads QueryPerformanceCounter() on Windows and
+// CLOCK_MONOTONIC where POSIX clocks are visible.
+#if defined(_WIN32)
+#    ifndef WIN32_LEAN_AND_MEAN
+#        define WIN32_LEAN_AND_MEAN
+#    endif
+#    include <windows.h>
+#endif
+
+#if defined(__linux__)
+#    include <sys/epoll.h>
+#    define WEN__EPOLL 1
+#endif
+
+// io_uring is driven through raw system calls, which need syscall().
+#if defined(__linux__) && (defined(_GNU_SOURCE) || defined(_DEFAULT_SOURCE) || defined(_BSD_SOURCE))
+#    include <linux/io_uring.h>
+#    if defined(IORING_RECV_MULTISHOT)
+#        include <errno.h>
+#        include <poll.h>
+#        include <sys/socket.h>
+#        include <sys/syscall.h>
+#        define WEN__URING 1
+#    endif
+#endif
+
+#if defined(__linux__) && (defined(_GNU_SOURCE) || defined(_DEFAULT_SOURCE) || defined(_BSD_SOURCE))
+#    include <arpa/inet.h>
+#    include <errno.h>
+#    include <fcntl.h>
+#    include <netinet/in.h>
+#    include <pthread.h>
+#    include <sched.h>
+#    include <sys/eventfd.h>
+#    include <sys/socket.h>
+#    define WEN__RUNTIME 1
+// CPU affinity is only declared with _GNU_SOURCE.
+#    if defined(CPU_SET)
+#        define WEN__PIN 1
+#    endif
+#endif
+
+// Completion tags kept in the low bits of an io_uring user_data.
+#define WEN__URING_RECV 1
+#define WEN__URING_SEND 2
+#define WEN__URING_LOOP 3
+#define WEN__URING_NONE 0xFFFFFFFFu
+
+WENDEF void wen_link_reset_buffers(wen_link *link)
+{
+    link->rx_off = 0;
+    link->rx_len = 0;
+    link->rx_held = 0;
+    link->tx_off = 0;
+    link->tx_len = 0;
+    link->tx_wrap = 0;
+    link->tx_ref_head = 0;
+    link->tx_ref_count = 0;
+    link->tx_ref_done = 0;
+    link->tx_ref_bytes = 0;
+}
+
+// Resolves the defaults in [config] into [out].
+WENDEF void wen__link_config(const wen_link_config *config, wen_link_config *out)
+{
+    if (config && config->pool) *out = config->pool->config;
+    else if (config) *out = *config;
+    else memset(out, 0, sizeof(*out));
+
+    if (!out->rx_size) out->rx_size = WEN_RX_BUFFER;
+    if (!out->tx_size) out->tx_size = WEN_TX_BUFFER;
+    if (!out->arena_size) out->arena_size = out->rx_size + out->tx_size;
+}
+
+WENDEF unsigned long wen_link_mem_size(const wen_link_config *config)
+{
+    wen_link_config c;
+    wen__link_config(config, &c);
+
+    return WEN_ALIGN_UP(c.rx_size, WEN_ARENA_ALIGN)
+         + WEN_ALIGN_UP(c.tx_size, WEN_ARENA_ALIGN)
+         + c.arena_size;
+}
+
+WENDEF wen_result wen_link_init(wen_link *link, wen_io io) {
+    return wen_link_init_ex(link, io, NULL);
+}
+
+WENDEF wen_result wen_link_init_ex(wen_link *link, wen_io io, const wen_link_config *config)
+{
+    if (!link || !io.read || !io.write) return WEN_ERR_STATE;
+
+    WEN_ASSERT(io.read != NULL && io.write != NULL);
+
+    wen_link_config c;
+    wen__link_config(config, &c);
+    if (c.rx_size < WEN_MIN_BUFFER || c.tx_size < WEN_MIN_BUFFER) return WEN_ERR_STATE;
+
+    unsigned long size = wen_link_mem_size(&c);
+    unsigned char *mem = (unsigned char *)c.mem;
+    if (mem && c.mem_size < size) return WEN_ERR_OVERFLOW;
+
+    memset(link, 0, sizeof(*link));
+
+    link->state = WEN_LINK_INIT;
+    link->io    = io;
+    link->slice_limit = 1;
+    link->budget = config ? config->budget : NULL;
+    link->arena.pages = config ? config->arena_pages : NULL;
+
+    // Pooled links start out without buffers.
+    if (config && config->pool) {
+        link->pool = config->pool;
+        return WEN_OK;
+    }
+
+    wen_result r = wen__link_charge(link, size);
+    if (r != WEN_OK) return r;
+
+    if (!mem) {
+#ifdef WEN_NO_MALLOC
+        wen__link_uncharge(link);
+        return WEN_ERR_UNSUPPORTED;
+#else
+        mem = (unsigned char *)malloc(size);
+        if (!mem) {
+            wen__link_uncharge(link);
+            return WEN_ERR_IO;
+        }
+        link->owns_mem = true;
+#endif
+    }
+    wen__link_carve(link, mem, &c);
+
+    return WEN_OK;
+}
+
+WENDEF void wen__link_carve(wen_link *link, unsigned char *mem, const wen_link_config *config)
+{
+    link->mem = mem;
+
+    // One block: rx_buf, tx_buf, then the arena.
+    link->rx_buf = mem;
+    link->rx_cap = config->rx_size;
+    mem += WEN_ALIGN_UP(config->rx_size, WEN_ARENA_ALIGN);
+    link->tx_buf = mem;
+    link->tx_cap = config->tx_size;
+    mem += WEN_ALIGN_UP(config->tx_size, WEN_ARENA_ALIGN);
+
+    wen_page_pool *pages = link->arena.pages;
+    wen_arena_bind(&link->arena, mem, config->arena_size);
+    wen_arena_chain(&link->arena, pages);
+
+    wen_link_reset_buffers(link);
+    link->slice_arena_base = 0;
+}
+
+WENDEF wen_result wen__link_charge(wen_link *link, unsigned long size)
+{
+    if (link->budget) {
+        wen_result r = wen_budget_charge(link->budget, size);
+        if (r != WEN_OK) return r;
+    }
+    link->charged += size;
+    return WEN_OK;
+}
+
+WENDEF void wen__link_uncharge(wen_link *link)
+{
+    if (link->budget) wen_budget_release(link->budget, link->charged);
+    link->charged = 0;
+}
+
+WENDEF wen_result wen__link_attach(wen_link *link)
+{
+    if (link->mem) return WEN_OK;
+    if (!link->pool || !link->pool->free_list) return WEN_ERR_OVERFLOW;
+
+    wen_buffer_pool *pool = link->pool;
+    wen_result r = wen__link_charge(link, pool->block_size);
+    if (r != WEN_OK) return r;
+
+    unsigned char *block = (unsigned char *)pool->free_list;
+    pool->free_list = *(void **)block;
+    pool->available--;
+
+    wen__pool_unwait(link);
+    wen__link_carve(link, block, &pool->config);
+    return WEN_OK;
+}
+
+WENDEF void wen__link_detach_idle(wen_link *link)
+{
+    if (!link->pool || !link->mem || link->state != WEN_LINK_OPEN) return;
+    if (link->rx_len || link->rx_held || link->tx_len || link->tx_ref_count) return;
+    if (wen_link_slices_outstanding(link) || link->arena.used) return;
+
+    // Only the block goes back; the link stays on its timer wheel.
+    wen__link_free_mem(link);
+}
+
+WENDEF void wen__pool_wait(wen_link *link)
+{
+    wen_buffer_pool *pool = link->pool;
+    if (!pool || link->pool_waiting) return;
+
+    link->pool_waiting = true;
+    link->pool_next = NULL;
+    link->pool_prev = pool->waiters_tail;
+    if (pool->waiters_tail)
+        pool->waiters_tail->pool_next = link;
+    else
+        pool->waiters = link;
+    pool->waiters_tail = link;
+}
+
+WENDEF void wen__pool_unwait(wen_link *link)
+{
+    if (!link->pool_waiting) return;
+
+    wen_buffer_pool *pool = link->pool;
+    if (link->pool_prev)
+        link->pool_prev->pool_next = link->pool_next;
+    else
+        pool->waiters = link->pool_next;
+    if (link->pool_next)
+        link->pool_next->pool_prev = link->pool_prev;
+    else
+        pool->waiters_tail = link->pool_prev;
+
+    link->pool_waiting = false;
+    link->pool_next = NULL;
+    link->pool_prev = NULL;
+}
+
+WENDEF void wen__pool_wake(wen_buffer_pool *pool)
+{
+    wen_link *link = pool->waiters;
+    if (!link) return;
+
+    // The edge that found the pool empty is gone; poll the link again.
+    wen__pool_unwait(link);
+    link->rx_drained = false;
+    if (link->loop) wen__loop_queue(link->loop, link);
+}
+
+WENDEF wen_result wen_link_reuse(wen_link *link, wen_io io)
+{
+    if (!link || !io.read || !io.write) return WEN_ERR_STATE;
+    if (!link->mem && !link->pool) return WEN_ERR_STATE;
+
+    // A pooled link has nothing buffered any more; give its block back.
+    if (link->pool && link->mem) wen__link_free_mem(link);
+    wen_timers_remove(link);
+    wen__pool_unwait(link);
+
+    link->state = WEN_LINK_INIT;
+    link->close_queued = false;
+    link->rx_drained = false;
+    link->tx_blocked = false;
+    link->frame_len = 0;
+    link->frame_split = false;
+    link->codec = NULL;
+    link->codec_state = NULL;
+    link->io = io;
+
+    link->slice_first = 0;
+    link->slice_next = 0;
+    link->slice_limit = 1;
+    link->slice_arena_base = 0;
+    link->slice_mode = WEN_SLICE_COPY;
+    link->drain_reads = 0;
+    link->drain_bytes = 0;
+    link->user_data = NULL;
+    link->handlers = NULL;
+    link->dispatching = false;
+    link->in_handler = false;
+
+    link->evq.head = 0;
+    link->evq.tail = 0;
+    wen_arena_reset(&link->arena, 0);
+    wen_link_reset_buffers(link);
+
+    wen__link_sync(link);
+    return WEN_OK;
+}
+
+WENDEF unsigned long wen_link_pool_mem_size(const wen_link_config *config, unsigned count)
+{
+    wen_link_config c;
+    wen__link_config(config, &c);
+
+    unsigned long block = (config && config->pool) ? 0 : WEN_ALIGN_UP(wen_link_mem_size(&c), WEN_ARENA_ALIGN);
+    return (sizeof(wen_link) + sizeof(wen_link *) + block) * count;
+}
+
+WENDEF wen_result wen_link_pool_bind(wen_link_pool *pool, const wen_link_config *config, unsigned count,
+                                     void *mem, unsigned long size)
+{
+    if (!pool || !mem || count == 0) return WEN_ERR_STATE;
+    if (size < wen_link_pool_mem_size(config, count)) return WEN_ERR_OVERFLOW;
+
+    wen_link_config c;
+    wen__link_config(config, &c);
+    if (c.rx_size < WEN_MIN_BUFFER || c.tx_size < WEN_MIN_BUFFER) return WEN_ERR_STATE;
+
+    memset(pool, 0, sizeof(*pool));
+    pool->mem = mem;
+    pool->count = count;
+
+    // Links first, then the free stack, then one buffer block per link.
+    unsigned char *p = (unsigned char *)mem;
+    pool->links = (wen_link *)p;
+    p += sizeof(wen_link) * count;
+    pool->free = (wen_link **)p;
+    p += sizeof(wen_link *) * count;
+
+    memset(pool->links, 0, sizeof(wen_link) * count);
+
+    unsigned long block = WEN_ALIGN_UP(wen_link_mem_size(&c), WEN_ARENA_ALIGN);
+    if (!(config && config->pool)) pool->block_size = block;
+
+    for (unsigned i = count; i-- > 0;) {
+        wen_link *link = &pool->links[i];
+        link->state = WEN_LINK_CLOSED;
+        link->slice_limit = 1;
+        link->budget = config ? config->budget : NULL;
+        link->arena.pages = config ? config->arena_pages : NULL;
+
+        if (config && config->pool) link->pool = config->pool;
+        else wen__link_carve(link, p + (unsigned long)i * block, &c);
+
+        pool->free[pool->available++] = link;
+    }
+
+    return WEN_OK;
+}
+
+WENDEF wen_result wen_link_pool_init(wen_link_pool *pool, const wen_link_config *config, unsigned count)
+{
+    if (!pool || count == 0) return WEN_ERR_STATE;
+
+#ifdef WEN_NO_MALLOC
+    WEN_UNUSED(config);
+    return WEN_ERR_UNSUPPORTED;
+#else
+    unsigned long size = wen_link_pool_mem_size(config, count);
+    void *mem = malloc(size);
+    if (!mem) return WEN_ERR_IO;
+
+    wen_result r = wen_link_pool_bind(pool, config, count, mem, size);
+    if (r != WEN_OK) {
+        free(mem);
+        return r;
+    }
+    pool->owns_memory = true;
+    return WEN_OK;
+#endif
+}
+
+WENDEF void wen_link_pool_free(wen_link_pool *pool)
+{
+    if (!pool) return;
+
+    // Links on a buffer pool may still hold a block.
+    for (unsigned i = 0; i < pool->count; i++)
+        if (pool->links[i].pool) wen_link_deinit(&pool->links[i]);
+
+#ifndef WEN_NO_MALLOC
+    if (pool->owns_memory && pool->mem)
+        free(pool->mem);
+#endif
+
+    memset(pool, 0, sizeof(*pool));
+}
+
+WENDEF wen_link *wen_link_pool_acquire(wen_link_pool *pool, wen_io io)
+{
+    if (!pool || pool->available == 0) return NULL;
+
+    wen_link *link = pool->free[pool->available - 1];
+    if (wen_link_reuse(link, io) != WEN_OK) return NULL;
+
+    // Links on a buffer pool are charged when they borrow a block instead.
+    if (!link->pool && link->mem && wen__link_charge(link, pool->block_size) != WEN_OK)
+        return NULL;
+
+    pool->available--;
+    return link;
+}
+
+WENDEF void wen_link_pool_release(wen_link_pool *pool, wen_link *link)
+{
+    if (!pool || !link) return;
+    WEN_ASSERT(link >= pool->links && link < pool->links + pool->count && "wen_link_pool_release: foreign link");
+    WEN_ASSERT(pool->available < pool->count && "wen_link_pool_release: pool already full");
+
+    wen_timers_remove(link);
+    wen__pool_unwait(link);
+    if (link->pool && link->mem) wen__link_free_mem(link);
+    wen__link_uncharge(link);
+    link->state = WEN_LINK_CLOSED;
+    pool->free[pool->available++] = link;
+}
+
+WENDEF void wen_budget_init(wen_budget *budget, unsigned long limit)
+{
+    budget->limit = limit;
+    budget->used = 0;
+    budget->peak = 0;
+}
+
+WENDEF wen_result wen_budget_charge(wen_budget *budget, unsigned long size)
+{
+    if (budget->limit && size > budget->limit - WEN_MIN(budget->used, budget->limit))
+        return WEN_ERR_BUDGET;
+
+    budget->used += size;
+    if (budget->used > budget->peak) budget->peak = budget->used;
+    return WEN_OK;
+}
+
+WENDEF void wen_budget_release(wen_budget *budget, unsigned long size)
+{
+    WEN_ASSERT(size <= budget->used && "wen_budget_release: more than was charged");
+    budget->used -= WEN_MIN(size, budget->used);
+}
+
+WENDEF unsigned long wen_link_table_mem_size(unsigned cap)
+{
+    return (sizeof(wen_link *) + 3 * sizeof(unsigned long) + 2) * (unsigned long)cap;
+}
+
+WENDEF wen_result wen_link_table_bind(wen_link_table *table, unsigned cap, void *mem, unsigned long size)
+{
+    if (!table || !mem || cap == 0) return WEN_ERR_STATE;
+    if (size < wen_link_table_mem_size(cap)) return WEN_ERR_OVERFLOW;
+
+    memset(table, 0, sizeof(*table));
+    table->mem = mem;
+    table->cap = cap;
+
+    // Widest arrays first so every one of them stays aligned.
+    unsigned char *p = (unsigned char *)mem;
+    table->links = (wen_link **)p;
+    p += sizeof(wen_link *) * cap;
+    table->rx_len = (unsigned long *)p;
+    p += sizeof(unsigned long) * cap;
+    table->tx_len = (unsigned long *)p;
+    p += sizeof(unsigned long) * cap;
+    table->deadline = (unsigned long *)p;
+    p += sizeof(unsigned long) * cap;
+    table->state = p;
+    p += cap;
+    table->flags = p;
+
+    return WEN_OK;
+}
+
+WENDEF wen_result wen_link_table_init(wen_link_table *table, unsigned cap)
+{
+    if (!table || cap == 0) return WEN_ERR_STATE;
+
+#ifdef WEN_NO_MALLOC
+    return WEN_ERR_UNSUPPORTED;
+#else
+    unsigned long size = wen_link_table_mem_size(cap);
+    void *mem = malloc(size);
+    if (!mem) return WEN_ERR_IO;
+
+    wen_result r = wen_link_table_bind(table, cap, mem, size);
+    if (r != WEN_OK) {
+        free(mem);
+        return r;
+    }
+    table->owns_memory = true;
+    return WEN_OK;
+#endif
+}
+
+WENDEF void wen_link_table_free(wen_link_table *table)
+{
+    if (!table) return;
+
+    for (unsigned i = 0; i < table->count; i++)
+        table->links[i]->table = NULL;
+
+#ifndef WEN_NO_MALLOC
+    if (table->owns_memory && table->mem)
+        free(table->mem);
+#endif
+
+    memset(table, 0, sizeof(*table));
+}
+
+WENDEF wen_result wen_link_table_add(wen_link_table *table, wen_link *link)
+{
+    if (!table || !link || link->table) return WEN_ERR_STATE;
+    if (table->count == table->cap) return WEN_ERR_OVERFLOW;
+
+    unsigned i = table->count++;
+    table->links[i] = link;
+    table->deadline[i] = 0;
+    link->table = table;
+    link->table_index = i;
+
+    wen__link_sync(link);
+    return WEN_OK;
+}
+
+WENDEF void wen_link_table_remove(wen_link_table *table, wen_link *link)
+{
+    if (!table || !link || link->table != table) return;
+
+    // Swap the last entry into the hole.
+    unsigned i = link->table_index;
+    unsigned last = --table->count;
+    if (i != last) {
+        table->links[i] = table->links[last];
+        table->state[i] = table->state[last];
+        table->flags[i] = table->flags[last];
+        table->rx_len[i] = table->rx_len[last];
+        table->tx_len[i] = table->tx_len[last];
+        table->deadline[i] = table->deadline[last];
+        table->links[i]->table_index = i;
+    }
+
+    link->table = NULL;
+    link->table_index = 0;
+}
+
+WENDEF void wen_link_table_set_deadline(wen_link_table *table, wen_link *link, unsigned long deadline)
+{
+    if (!table || !link || link->table != table) return;
+    table->deadline[link->table_index] = deadline;
+}
+
+WENDEF unsigned wen_link_table_expired(const wen_link_table *table, unsigned long now,
+                                       wen_link **out, unsigned cap)
+{
+    unsigned n = 0;
+    for (unsigned i = 0; i < table->count && n < cap; i++) {
+        unsigned long d = table->deadline[i];
+        if (d && d <= now) out[n++] = table->links[i];
+    }
+    return n;
+}
+
+WENDEF unsigned wen_link_table_find(const wen_link_table *table, unsigned mask, wen_link **out, unsigned cap)
+{
+    unsigned n = 0;
+    for (unsigned i = 0; i < table->count && n < cap; i++)
+        if (table->flags[i] & mask) out[n++] = table->links[i];
+    return n;
+}
+
+WENDEF void wen__link_sync(wen_link *link)
+{
+    if (link->loop) wen__loop_touch(link->loop, link);
+
+    wen_link_table *table = link->table;
+    if (!table) return;
+
+    unsigned i = link->table_index;
+    unsigned flags = 0;
+    if (link->rx_len) flags |= WEN_LINK_F_RX_PENDING;
+    if (link->tx_len || link->tx_ref_count) flags |= WEN_LINK_F_TX_PENDING;
+    if (link->tx_blocked) flags |= WEN_LINK_F_TX_BLOCKED;
+    if (link->evq.head != link->evq.tail) flags |= WEN_LINK_F_EVENTS;
+    if (link->slice_next != link->slice_first) flags |= WEN_LINK_F_SLICES;
+
+    table->state[i] = (unsigned char)link->state;
+    table->flags[i] = (unsigned char)flags;
+    table->rx_len[i] = link->rx_len;
+    table->tx_len[i] = link->tx_len;
+}
+
+WENDEF bool wen_link_has_buffers(const wen_link *link)
+{
+    return link->mem != NULL;
+}
+
+WENDEF void wen_link_deinit(wen_link *link)
+{
+    if (!link) return;
+
+    wen_timers_remove(link);
+    wen__pool_unwait(link);
+    wen__link_free_mem(link);
+}
+
+WENDEF void wen__link_free_mem(wen_link *link)
+{
+    bool returned = link->pool && link->mem;
+    if (returned) {
+        *(void **)link->mem = link->pool->free_list;
+        link->pool->free_list = link->mem;
+        link->pool->available++;
+    }
+
+    // Chained pages go back to their pool; the page pool itself stays set.
+    if (link->arena.page) wen_arena_reset(&link->arena, 0);
+
+#ifndef WEN_NO_MALLOC
+    if (link->arena.owns_memory && link->arena.base)
+        free(link->arena.base);
+    if (link->owns_mem && link->mem)
+        free(link->mem);
+#endif
+
+    link->arena.base = NULL;
+    link->arena.owns_memory = false;
+    link->arena.capacity = 0;
+    link->arena.used = 0;
+    link->mem = NULL;
+    link->owns_mem = false;
+    wen__link_uncharge(link);
+    link->rx_buf = NULL;
+    link->rx_cap = 0;
+    link->tx_buf = NULL;
+    link->tx_cap = 0;
+
+    if (returned) wen__pool_wake(link->pool);
+}
+
+WENDEF void wen_link_attach_codec(wen_link *link, const wen_codec *codec, void *codec_state)
+{
+    if (!link || !codec) return;
+    WEN_ASSERT(codec->handshake && "codec must provide handshake()");
+
+    link->codec       = codec;
+    link->codec_state = codec_state;
+    link->state       = WEN_LINK_HANDSHAKE;
+}
+
+WENDEF wen_result wen_link_set_slice_mode(wen_link *link, wen_slice_mode mode)
+{
+    if (!link) return WEN_ERR_STATE;
+    if (wen_link_slices_outstanding(link)) return WEN_ERR_STATE;
+
+    link->slice_mode = mode;
+    return WEN_OK;
+}
+
+WENDEF wen_result wen_link_set_slice_limit(wen_link *link, unsigned limit)
+{
+    if (!link || limit == 0) return WEN_ERR_STATE;
+    if (limit > WEN_MAX_OUTSTANDING) return WEN_ERR_OVERFLOW;
+
+    link->slice_limit = limit;
+    return WEN_OK;
+}
+
+WENDEF void wen_link_set_drain(wen_link *link, unsigned max_reads, unsigned long max_bytes)
+{
+    if (!link) return;
+
+    link->drain_reads = max_reads;
+    link->drain_bytes = max_bytes;
+}
+
+WENDEF bool wen_link_rx_drained(const wen_link *link)
+{
+    return link->rx_drained;
+}
+
+WENDEF bool wen_link_tx_blocked(const wen_link *link)
+{
+    return link->tx_blocked;
+}
+
+WENDEF unsigned wen_link_slices_outstanding(const wen_link *link)
+{
+    return link->slice_next - link->slice_first;
+}
+
+WENDEF bool wen_poll(wen_link *link, wen_event *ev)
+{
+    if (!link || !ev) return false;
+
+    bool r = wen__poll_once(link, ev);
+    wen__link_sync(link);
+    return r;
+}
+
+WENDEF bool wen_poll_interest(wen_link *link, wen_event *ev, unsigned *interest, long *next_ms)
+{
+    bool r = wen_poll(link, ev);
+    if (interest) *interest = link ? wen__link_interest(link, r) : 0;
+    if (next_ms) *next_ms = wen_link_next_deadline(link);
+    return r;
+}
+
+WENDEF unsigned wen__link_interest(const wen_link *link, bool produced)
+{
+    unsigned interest = 0;
+    if (link->evq.head != link->evq.tail) interest |= WEN_HAS_EVENTS;
+    if (link->state == WEN_LINK_CLOSED) return interest;
+
+    // A poll that came up empty already tried whatever was buffered.
+    bool slots = wen_link_slices_outstanding(link) < link->slice_limit;
+    if (produced && link->rx_len && slots) interest |= WEN_HAS_EVENTS;
+    if (link->drain_reads && !link->rx_drained) interest |= WEN_HAS_EVENTS;
+
+    // Pooled links hand back idle buffers and borrow them again on the next read.
+    bool detached = link->pool && !link->mem;
+    if (detached || link->rx_len < link->rx_cap) interest |= WEN_WANT_READ;
+    if (link->tx_len || link->tx_ref_count) interest |= WEN_WANT_WRITE;
+    return interest;
+}
+
+WENDEF long wen_link_next_deadline(const wen_link *link)
+{
+    if (!link || !link->timers) return -1;
+
+    unsigned long long due = wen__link_deadline(link);
+    if (!due) return -1;
+    return due > link->timers->now ? (long)(due - link->timers->now) : 0;
+}
+
+WENDEF void wen_link_set_handlers(wen_link *link, const wen_handlers *handlers)
+{
+    if (link) link->handlers = handlers;
+}
+
+WENDEF unsigned wen_dispatch(wen_link *link, unsigned max)
+{
+    if (!link || !link->handlers || link->in_handler) return 0;
+
+    // Buffered frames first, then a single I/O pass, as in wen_poll_batch().
+    // Returns after on_close() leave the link alone.
+    link->dispatching = true;
+    bool closed = false;
+    unsigned n = wen__dispatch_drain(link, 0, max, &closed);
+    if (closed) return n;
+
+    if (n < max && link->state != WEN_LINK_CLOSED) {
+        wen_event ev;
+        unsigned long before = link->dispatched;
+        unsigned io = wen__poll_io(link, &ev);
+        n += (unsigned)(link->dispatched - before);
+        if (io != (unsigned)-1 && io) {
+            n++;
+            if (!wen__dispatch_event(link, &ev)) return n;
+        }
+        n = wen__dispatch_drain(link, n, max, &closed);
+        if (closed) return n;
+    }
+
+    link->dispatching = false;
+    wen__link_sync(link);
+    return n;
+}
+
+WENDEF unsigned wen__dispatch_drain(wen_link *link, unsigned n, unsigned max, bool *closed)
+{
+    wen_event ev;
+
+    while (n < max) {
+        if (wen__poll_pop(link, &ev)) {
+            n++;
+            if (!wen__dispatch_event(link, &ev)) {
+                *closed = true;
+                return n;
+            }
+            continue;
+        }
+        if (link->state == WEN_LINK_CLOSED || !link->codec || link->rx_len == 0) break;
+
+        unsigned long pending = link->rx_len;
+        unsigned long before = link->dispatched;
+        bool produced = link->state == WEN_LINK_HANDSHAKE
+            ? wen__poll_handshake(link, &ev)
+            : wen__poll_decode(link, &ev);
+        n += (unsigned)(link->dispatched - before);
+
+        if (produced) {
+            n++;
+            if (!wen__dispatch_event(link, &ev)) {
+                *closed = true;
+                return n;
+            }
+            if (ev.type == WEN_EV_ERROR) break;
+            continue;
+        }
+
+        // Nothing decodable left, or out of slice slots.
+        if (link->rx_len == pending && link->evq.head == link->evq.tail) break;
+    }
+    return n;
+}
+
+WENDEF bool wen__dispatch_event(wen_link *link, const wen_event *ev)
+{
+    const wen_handlers *h = link->handlers;
+    link->dispatched++;
+
+    // The link may be gone once on_close() returns.
+    if (ev->type == WEN_EV_CLOSE && h->on_close) {
+        h->on_close(link);
+        return false;
+    }
+
+    bool handled = true;
+    link->in_handler = true;
+    switch (ev->type) {
+    case WEN_EV_OPEN:
+        if (h->on_open) h->on_open(link); else handled = false;
+        break;
+    case WEN_EV_SLICE:
+        if (h->on_slice) h->on_slice(link, ev->as.slice); else handled = false;
+        break;
+    case WEN_EV_ERROR:
+        if (h->on_error) h->on_error(link, ev->as.error); else handled = false;
+        break;
+    case WEN_EV_TIMEOUT:
+        if (h->on_timeout) h->on_timeout(link, ev->as.timeout); else handled = false;
+        break;
+    default:
+        handled = false;
+        break;
+    }
+
+    if (!handled && h->on_event) {
+        h->on_event(link, ev);
+    } else if (!handled && ev->type == WEN_EV_SLICE) {
+        wen_release(link, ev->as.slice);
+    }
+    link->in_handler = false;
+    return ev->type != WEN_EV_CLOSE;
+}
+
+WENDEF bool wen__poll_once(wen_link *link, wen_event *ev)
+{
+    // The event queue has priority.
+    // If something was already generated on a previous call, return it before doing any I/O.
+    if (wen__poll_pop(link, ev)) return true;
+
+    unsigned io = wen__poll_io(link, ev);
+    if (io != (unsigned)-1) return io;
+
+    if (link->state == WEN_LINK_HANDSHAKE) 
+        return wen__poll_handshake(link, ev);
 
     return wen__poll_decode(link, ev);
 }
 
-WENDEF unsigned wen__poll_flush_tx(wen_link *link, wen_event *ev)
+WENDEF unsigned wen_poll_batch(wen_link *link, wen_event *out, unsigned cap)
+{
+    if (!link || !out) return 0;
+
+    unsigned n = wen__poll_batch(link, out, cap);
+    wen__link_sync(link);
+    return n;
+}
+
+WENDEF unsigned wen__poll_batch(wen_link *link, wen_event *out, unsigned cap)
+{
+    // Frames that are already buffered need no I/O at all.
+    unsigned n = wen__poll_drain(link, out, 0, cap);
+    if (n == cap || link->state == WEN_LINK_CLOSED) return n;
+
+    // A single I/O pass for the whole batch.
+    wen_event ev;
+    unsigned io = wen__poll_io(link, &ev);
+    if (io != (unsigned)-1) {
+        if (io) out[n++] = ev;
+        while (n < cap && wen__poll_pop(link, &out[n])) n++;
+        return n;
+    }
+
+    // A handshake finished by the drain leaves a pooled link idle as well.
+    n = wen__poll_drain(link, out, n, cap);
+    wen__link_detach_idle(link);
+    return n;
+}
+
+WENDEF unsigned wen__poll_drain(wen_link *link, wen_event *out, unsigned n, unsigned cap)
+{
+    wen_event ev;
+
+    while (n < cap) {
+        if (wen__poll_pop(link, &out[n])) {
+            n++;
+            continue;
+        }
+        if (link->state == WEN_LINK_CLOSED || !link->codec || link->rx_len == 0) break;
+
+        unsigned long pending = link->rx_len;
+        bool produced = link->state == WEN_LINK_HANDSHAKE
+            ? wen__poll_handshake(link, &ev)
+            : wen__poll_decode(link, &ev);
+
+        if (produced) {
+            out[n++] = ev;
+            if (ev.type == WEN_EV_ERROR) break;
+            continue;
+        }
+
+        // Nothing decodable left, or out of slice slots.
+        if (link->rx_len == pending && link->evq.head == link->evq.tail) break;
+    }
+    return n;
+}
+
+WENDEF bool wen__poll_pop(wen_link *link, wen_event *ev)
+{
+    if (!wen_evq_pop(&link->evq, ev)) return false;
+
+    if (ev->type == WEN_EV_CLOSE && link->state != WEN_LINK_CLOSED) {
+        link->state = WEN_LINK_CLOSED;
+        link->close_queued = false;
+
+        // Caller-provided memory stays attached for wen_link_reuse().
+        wen_timers_remove(link);
+        wen__pool_unwait(link);
+        if (link->owns_mem || link->pool || link->arena.owns_memory)
+            wen__link_free_mem(link);
+    }
+    return true;
+}
+
+WENDEF unsigned wen__poll_io(wen_link *link, wen_event *ev)
+{
+    if (link->state == WEN_LINK_CLOSED) return false;
+
+    if (!link->codec) {
+        ev->type = WEN_EV_ERROR;
+        ev->as.error = WEN_ERR_UNSUPPORTED;
+        return true;
+    }
+
+    // Pooled links borrow their buffers only for the duration of the I/O;
+    // with the pool exhausted the transport is left alone until a block
+    // comes back and wakes the link.
+    if (wen__link_attach(link) != WEN_OK) {
+        wen__pool_wait(link);
+        return false;
+    }
+
+    // Flush pending TX
+    unsigned r = wen__poll_flush_tx(link, ev);
+
+    // Single RX read
+    if (r == (unsigned)-1) r = wen__poll_read_rx(link, ev);
+
+    wen__link_detach_idle(link);
+    return r;
+}
+
+WENDEF unsigned wen__poll_flush_tx(wen_link *link, wen_event *ev)
+{
+    if (link->tx_len == 0 && link->tx_ref_count == 0) return -1;
+
+    // With writev, the wrapped backlog and the referenced payloads go out in one call.
+    wen_iovec iov[WEN_IOV_MAX];
+    unsigned iovcnt = wen__tx_gather(link, iov, link->io.writev ? WEN_IOV_MAX : 1);
+
+    long nw = 0;
+    if (iovcnt > 1)
+        nw = link->io.writev(link->io.user, iov, iovcnt);
+    else if (iovcnt == 1)
+        nw = link->io.write(link->io.user, iov[0].base, iov[0].len);
+
+    // The transport is congested; move on to reading and try again next poll.
+    if (nw == WEN_IO_WOULD_BLOCK) {
+        link->tx_blocked = true;
+        return -1;
+    }
+    if (nw < 0) {
+        ev->type = WEN_EV_ERROR;
+        ev->as.error = WEN_ERR_IO;
+        return true;
+    }
+    link->tx_blocked = false;
+    wen__tx_advance(link, (unsigned long)nw);
+    if (!link->close_queued && link->state >= WEN_LINK_CLOSING && !wen_link_slices_outstanding(link)) {
+        wen_event cev = { .type = WEN_EV_CLOSE };
+        wen_evq_push(&link->evq, &cev);
+        link->close_queued = true;
+    }
+    return false;
+}
+
+WENDEF unsigned wen__poll_read_rx(wen_link *link, wen_event *ev)
+{
+    // The handshake needs its input contiguous, so do not wrap before the link is open.
+    if (link->state == WEN_LINK_HANDSHAKE && link->rx_off + link->rx_len == link->rx_cap)
+        wen__rx_compact(link);
+
+    unsigned reads = 0;
+    unsigned long total = 0;
+    link->rx_drained = false;
+
+    for (;;) {
+        unsigned long end = 0;
+        unsigned long front = 0;
+        unsigned long room = wen__rx_room(link, &end, &front);
+
+        // In drain mode, make space by decoding what is buffered into the event queue.
+        if (room == 0 && link->drain_reads && link->state == WEN_LINK_OPEN) {
+            unsigned r = wen__rx_decode_ahead(link, ev);
+            if (r != (unsigned)-1) return r;
+            room = wen__rx_room(link, &end, &front);
+        }
+        if (room == 0) break;
+
+        long nread;
+        unsigned long offered = room;
+        if (link->io.readv && front > 0) {
+            // Fill the tail and the free front of the ring in one call.
+            wen_iovec iov[2] = {
+                { link->rx_buf + end, room },
+                { link->rx_buf, front },
+            };
+            offered += front;
+            nread = link->io.readv(link->io.user, iov, 2);
+        } else {
+            nread = link->io.read(link->io.user, link->rx_buf + end, room);
+        }
+
+        // Nothing to read right now; carry on with what is buffered.
+        if (nread == WEN_IO_WOULD_BLOCK) {
+            link->rx_drained = true;
+            break;
+        }
+        if (nread < 0) {
+            ev->type = WEN_EV_ERROR;
+            ev->as.error = WEN_ERR_IO;
+            return true;
+        }
+
+        if (nread == 0) {
+            if (link->state < WEN_LINK_CLOSING)
+                link->state = WEN_LINK_CLOSING;
+
+            if (!link->close_queued && !wen_link_slices_outstanding(link)) {
+                wen_event cev = { .type = WEN_EV_CLOSE };
+                wen_evq_push(&link->evq, &cev);
+                link->close_queued = true;
+            }
+
+            return false;
+        }
+
+        link->rx_len += (unsigned long)nread;
+        if (link->timers) link->last_rx = link->timers->now;
+        reads++;
+        total += (unsigned long)nread;
+
+        // Without drain mode, a single read per poll.
+        if (!link->drain_reads) break;
+
+        // A short read means the transport has nothing more right now.
+        if ((unsigned long)nread < offered) {
+            link->rx_drained = true;
+            break;
+        }
+        if (reads >= link->drain_reads) break;
+        if (link->drain_bytes && total >= link->drain_bytes) break;
+    }
+    return -1;
+}
+
+WENDEF unsigned long wen__rx_room(const wen_link *link, unsigned long *end, unsigned long *front)
+{
+    // Read into the free space right after the pending bytes, up to the end of
+    // rx_buf or up to the first held or pending byte once the ring has wrapped.
+    unsigned long base = link->rx_off >= link->rx_held
+        ? link->rx_off - link->rx_held
+        : link->rx_off + link->rx_cap - link->rx_held;
+
+    *end = base + link->rx_held + link->rx_len;
+    *front = 0;
+    if (*end < link->rx_cap) {
+        if (link->state != WEN_LINK_HANDSHAKE) *front = base;
+        return link->rx_cap - *end;
+    }
+
+    *end -= link->rx_cap;
+    return base - *end;
+}
+
+WENDEF unsigned wen__rx_decode_ahead(wen_link *link, wen_event *ev)
+{
+    // Leave half of the queue for events the codec pushes on its own.
+    while (link->rx_len && wen_evq_len(&link->evq) < WEN_EVENT_QUEUE_CAP / 2) {
+        unsigned long pending = link->rx_len;
+        if (wen__poll_decode(link, ev)) return true;
+        if (link->rx_len == pending) break;
+    }
+    return -1;
+}
+
+WENDEF bool wen__poll_handshake(wen_link *link, wen_event *ev)
+{
+    unsigned long consumed = 0;
+    unsigned long out_len = 0;
+    unsigned long room = 0;
+    unsigned char *out = wen__tx_tail(link, &room);
+
+    wen_handshake_status hs =
+        link->codec->handshake(
+            link->codec_state,
+            link->rx_buf + link->rx_off, wen__rx_span(link),
+            &consumed,
+            out, room,
+            &out_len);
+
+    if (out_len) {
+        link->tx_len += out_len;
+        if (link->tx_wrap) link->tx_wrap += out_len;
+    }
+
+    wen__rx_consume(link, consumed);
+
+    if (hs == WEN_HANDSHAKE_COMPLETE) {
+        link->state = WEN_LINK_OPEN;
+        ev->type = WEN_EV_OPEN;
+        return true;
+    }
+
+    if (hs == WEN_HANDSHAKE_FAILED) {
+        ev->type = WEN_EV_ERROR;
+        ev->as.error = WEN_ERR_PROTOCOL;
+        return true;
+    }
+
+    return false;
+}
+
+WENDEF bool wen__poll_decode(wen_link *link, wen_event *ev)
+{
+    // Out of slice slots: keep the data buffered until something is released.
+    unsigned outstanding = wen_link_slices_outstanding(link);
+    if (outstanding >= link->slice_limit) return false;
+    if (link->rx_len == 0) return false;
+
+    // decode() needs the head frame in one piece. At a frame boundary that
+    // wraps, the ring is straightened first; bytes held by zero-copy slices
+    // pin it until they are released.
+    unsigned long span = wen__rx_span(link);
+    if (link->codec->decode && !link->frame_len && span < link->rx_len) {
+        if (link->rx_held) return false;
+        wen__rx_linearize(link);
+        span = wen__rx_span(link);
+    }
+
+    // Slices never cross the end of rx_buf; frames longer than what is
+    // contiguous or WEN_MAX_SLICE are delivered in several slices.
+    unsigned long slice_length =
+        link->frame_len ? WEN_MIN(link->frame_len, WEN_MAX_SLICE) : WEN_MIN(span, WEN_MAX_SLICE);
+
+    // Decode is codec-specific and opaque.
+    // It is only consulted at frame boundaries, never in the middle of a frame.
+    if (link->codec->decode && !link->frame_len) {
+        wen_result r = link->codec->decode(link->codec_state, link->rx_buf + link->rx_off, slice_length);
+        if (r != WEN_OK) {
+            ev->type = WEN_EV_ERROR;
+            ev->as.error = r;
+            return true;
+        }
+    }
+
+    // decode() may have just reported the length of the frame at the head.
+    if (link->frame_len) slice_length = WEN_MIN(slice_length, link->frame_len);
+    slice_length = WEN_MIN3(slice_length, WEN_MAX_SLICE, span);
+
+    // Create slice event
+    if (slice_length == 0) return false;
+    wen_arena_snapshot snap = link->arena.used;
+    void *dst = link->rx_buf + link->rx_off;
+    if (link->slice_mode == WEN_SLICE_COPY) {
+        dst = wen_arena_alloc(&link->arena, slice_length);
+        if (!dst) {
+            // Wait for outstanding slices to give their arena space back.
+            if (outstanding) return false;
+            ev->type = WEN_EV_ERROR;
+            ev->as.error = WEN_ERR_OVERFLOW;
+            return true;
+        }
+
+        memcpy(dst, link->rx_buf + link->rx_off, slice_length);
+    }
+
+    // Pieces of a split frame are flagged BEGIN, CONT..., END.
+    bool last = link->frame_len <= slice_length;
+    unsigned flags = last ? WEN_SLICE_END : 0;
+    flags |= link->frame_split ? (last ? 0 : WEN_SLICE_CONT) : WEN_SLICE_BEGIN;
+
+    wen_event sev = {
+        .type              = WEN_EV_SLICE,
+        .as.slice.data     = dst,
+        .as.slice.len      = slice_length,
+        .as.slice.flags    = flags,
+        .as.slice.snapshot = snap,
+        .as.slice.handle   = link->slice_next,
+    };
+
+    // Inside wen_dispatch() with nothing queued ahead of it, the slice is
+    // handed over directly once the link is consistent again.
+    bool direct = link->dispatching && link->handlers && !link->in_handler &&
+                  link->evq.head == link->evq.tail;
+
+    // Enqueue event
+    if (!direct && !wen_evq_push(&link->evq, &sev)) {
+        wen_arena_reset(&link->arena, snap);
+        ev->type = WEN_EV_ERROR;
+        ev->as.error = WEN_ERR_OVERFLOW;
+        return true;
+    }
+
+    // A zero-copy slice keeps its bytes held in rx_buf until it is released.
+    wen_slice_slot *slot = &link->slices[link->slice_next % WEN_MAX_OUTSTANDING];
+    slot->held     = link->slice_mode == WEN_SLICE_ZERO_COPY ? slice_length : 0;
+    slot->snapshot = snap;
+    slot->top      = link->arena.used;
+    slot->released = false;
+    if (outstanding == 0) link->slice_arena_base = snap;
+    link->slice_next++;
+
+    link->rx_held += slot->held;
+    wen__rx_consume(link, slice_length);
+
+    *ev = sev;
+
+    if (link->frame_len) link->frame_len -= slice_length;
+    link->frame_split = link->frame_len != 0;
+    if (direct) {
+        ev->type = WEN_EV_NONE;
+        wen__dispatch_event(link, &sev);
+    }
+    return false;
+}
+
+WENDEF unsigned long wen__rx_span(const wen_link *link)
+{
+    return WEN_MIN(link->rx_len, link->rx_cap - link->rx_off);
+}
+
+WENDEF void wen__rx_consume(wen_link *link, unsigned long n)
+{
+    WEN_ASSERT(n <= wen__rx_span(link) && "wen__rx_consume: past end of span");
+
+    // Retire consumed bytes by advancing the cursor. Rewinding to the start
+    // whenever the ring drains keeps the next read contiguous.
+    link->rx_len -= n;
+    link->rx_off += n;
+    if (link->rx_off == link->rx_cap || (link->rx_len == 0 && link->rx_held == 0))
+        link->rx_off = 0;
+}
+
+WENDEF void wen__rx_compact(wen_link *link)
+{
+    WEN_ASSERT(link->rx_off + link->rx_len <= link->rx_cap && "wen__rx_compact: ring is wrapped");
+    if (link->rx_off == 0) return;
+
+    memmove(link->rx_buf, link->rx_buf + link->rx_off, link->rx_len);
+    link->rx_off = 0;
+}
+
+WENDEF void wen__rx_linearize(wen_link *link)
+{
+    unsigned long span = wen__rx_span(link);
+    unsigned long front = link->rx_len - span;
+
+    if (link->rx_len <= link->rx_off) {
+        // Enough room before the tail: shift the front up and put the tail first.
+        memmove(link->rx_buf + span, link->rx_buf, front);
+        memmove(link->rx_buf, link->rx_buf + link->rx_off, span);
+    } else {
+        // Rotate the whole ring left by rx_off in place.
+        wen__reverse(link->rx_buf, link->rx_off);
+        wen__reverse(link->rx_buf + link->rx_off, link->rx_cap - link->rx_off);
+        wen__reverse(link->rx_buf, link->rx_cap);
+    }
+    link->rx_off = 0;
+}
+
+WENDEF void wen__reverse(unsigned char *p, unsigned long n)
+{
+    for (unsigned long i = 0, j = n; i + 1 < j; i++, j--) {
+        unsigned char t = p[i];
+        p[i] = p[j - 1];
+        p[j - 1] = t;
+    }
+}
+
+WENDEF unsigned long wen__tx_span(const wen_link *link)
+{
+    return link->tx_len - link->tx_wrap;
+}
+
+WENDEF void wen__tx_consume(wen_link *link, unsigned long n)
+{
+    WEN_ASSERT(n <= link->tx_len && "wen__tx_consume: past end of backlog");
+
+    do {
+        unsigned long step = WEN_MIN(n, wen__tx_span(link));
+        link->tx_off += step;
+        link->tx_len -= step;
+        n -= step;
+
+        // Once the bytes before the wrap are gone, the front region becomes the head.
+        if (link->tx_len == link->tx_wrap) {
+            link->tx_off = 0;
+            link->tx_wrap = 0;
+        }
+    } while (n > 0);
+}
+
+WENDEF unsigned char *wen__tx_tail(wen_link *link, unsigned long *room)
+{
+    if (link->tx_wrap) {
+        *room = link->tx_off - link->tx_wrap;
+        return link->tx_buf + link->tx_wrap;
+    }
+
+    unsigned long end = link->tx_off + link->tx_len;
+    *room = link->tx_cap - end;
+    return link->tx_buf + end;
+}
+
+WENDEF wen_result wen__tx_encode_into(wen_link *link, unsigned opcode, const void *data, unsigned long len,
+                                      bool header_only, void *out, unsigned long out_cap,
+                                      unsigned long *out_len)
+{
+    if (header_only)
+        return link->codec->encode_header(link->codec_state, opcode, len, out, out_cap, out_len);
+    return link->codec->encode(link->codec_state, opcode, data, len, out, out_cap, out_len);
+}
+
+WENDEF wen_result wen__tx_encode(wen_link *link, unsigned opcode, const void *data, unsigned long len,
+                                 bool header_only)
+{
+    unsigned long room = 0;
+    unsigned long out_len = 0;
+    unsigned char *out = wen__tx_tail(link, &room);
+
+    wen_result r = WEN_ERR_OVERFLOW;
+    if (room) r = wen__tx_encode_into(link, opcode, data, len, header_only, out, room, &out_len);
+
+    // The frame does not fit after the pending bytes; start over at the front if
+    // the flushed space there is free, instead of compacting the backlog.
+    if (r == WEN_ERR_OVERFLOW && !link->tx_wrap && link->tx_off > 0) {
+        r = wen__tx_encode_into(link, opcode, data, len, header_only, link->tx_buf, link->tx_off, &out_len);
+        if (r != WEN_OK) return r;
+
+        link->tx_len += out_len;
+        link->tx_wrap = out_len;
+        return WEN_OK;
+    }
+    if (r != WEN_OK) return r;
+
+    link->tx_len += out_len;
+    if (link->tx_wrap) link->tx_wrap += out_len;
+    return WEN_OK;
+}
+
+// Describes [count] backlog bytes starting [pos] bytes past the head with at most two buffers.
+WENDEF unsigned wen__tx_iov(wen_link *link, unsigned long pos, unsigned long count,
+                            wen_iovec *iov, unsigned max)
+{
+    unsigned long span = wen__tx_span(link);
+    unsigned n = 0;
+
+    if (count == 0 || max == 0) return 0;
+
+    if (pos < span) {
+        unsigned long c = WEN_MIN(count, span - pos);
+        iov[n].base = link->tx_buf + link->tx_off + pos;
+        iov[n].len  = c;
+        n++;
+        pos   += c;
+        count -= c;
+    }
+    if (count > 0 && n < max) {
+        iov[n].base = link->tx_buf + (pos - span);
+        iov[n].len  = count;
+        n++;
+    }
+    return n;
+}
+
+WENDEF unsigned wen__tx_gather(wen_link *link, wen_iovec *iov, unsigned max)
+{
+    unsigned n = 0;
+    unsigned long pos = 0;
+    unsigned active = link->tx_ref_count - link->tx_ref_done;
+
+    // Walk the wire order: backlog bytes, payload, backlog bytes, payload, ...
+    for (unsigned i = 0; i <= active && n < max; i++) {
+        wen_tx_ref *r = NULL;
+        unsigned long count = link->tx_len - pos;
+        if (i < active) {
+            r = &link->tx_refs[(link->tx_ref_head + link->tx_ref_done + i) % WEN_TX_REFS];
+            count = r->before;
+        }
+
+        n += wen__tx_iov(link, pos, count, iov + n, max - n);
+        pos += count;
+
+        if (r && r->sent < r->len && n < max) {
+            iov[n].base = (unsigned char *)r->data + r->sent;
+            iov[n].len  = r->len - r->sent;
+            n++;
+        }
+    }
+    return n;
+}
+
+WENDEF void wen__tx_advance(wen_link *link, unsigned long n)
+{
+    while (n > 0) {
+        if (link->tx_ref_done == link->tx_ref_count) {
+            wen__tx_consume(link, n);
+            break;
+        }
+
+        wen_tx_ref *r = &link->tx_refs[(link->tx_ref_head + link->tx_ref_done) % WEN_TX_REFS];
+        unsigned long step;
+        if (r->before) {
+            step = WEN_MIN(n, r->before);
+            wen__tx_consume(link, step);
+            r->before -= step;
+            link->tx_ref_bytes -= step;
+        } else {
+            step = WEN_MIN(n, r->len - r->sent);
+            r->sent += step;
+        }
+        n -= step;
+
+        if (r->before == 0 && r->sent == r->len)
+            link->tx_ref_done++;
+    }
+
+    // Empty payloads complete as soon as the header in front of them is out.
+    while (link->tx_ref_done < link->tx_ref_count) {
+        wen_tx_ref *r = &link->tx_refs[(link->tx_ref_head + link->tx_ref_done) % WEN_TX_REFS];
+        if (r->before || r->sent < r->len) break;
+        link->tx_ref_done++;
+    }
+
+    // Report completed payloads. If the event queue is full they are retried on the next flush.
+    while (link->tx_ref_done > 0) {
+        wen_tx_ref *r = &link->tx_refs[link->tx_ref_head];
+        wen_event sev = {
+            .type          = WEN_EV_SENT,
+            .as.sent.data  = r->data,
+            .as.sent.len   = r->len,
+            .as.sent.user  = r->user,
+        };
+        if (!wen_evq_push(&link->evq, &sev)) break;
+
+        link->tx_ref_head = (link->tx_ref_head + 1) % WEN_TX_REFS;
+        link->tx_ref_count--;
+        link->tx_ref_done--;
+    }
+}
+
+WENDEF bool wen__slice_live(const wen_link *link, unsigned handle)
+{
+    return handle - link->slice_first < wen_link_slices_outstanding(link) &&
+           !link->slices[handle % WEN_MAX_OUTSTANDING].released;
+}
+
+WENDEF void *wen_slice_alloc(wen_link *link, wen_slice slice, unsigned long size)
+{
+    if (!link || !wen__slice_live(link, slice.handle)) return NULL;
+
+    // Scratch sits above the slice's snapshot, so releasing the slice (and
+    // every slice after it) rolls it back along with the slice data. It may
+    // also land above newer slices; the high-water mark keeps it alive when
+    // those are released first.
+    void *p = wen_arena_alloc(&link->arena, size);
+    if (p) link->slices[slice.handle % WEN_MAX_OUTSTANDING].top = link->arena.used;
+    return p;
+}
+
+WENDEF void wen_release(wen_link *link, wen_slice slice)
+{
+    WEN_ASSERT(link && "wen_release: link is NULL");
+
+    bool live = wen__slice_live(link, slice.handle);
+    WEN_ASSERT(live && "wen_release called with no outstanding slice");
+    if (!live) return;
+
+    link->slices[slice.handle % WEN_MAX_OUTSTANDING].released = true;
+
+    // Arena memory is a stack: give back the space of the newest run of released slices.
+    unsigned h = link->slice_next;
+    wen_arena_snapshot mark = link->arena.used;
+    while (h != link->slice_first && link->slices[(h - 1) % WEN_MAX_OUTSTANDING].released) {
+        h--;
+        mark = link->slices[h % WEN_MAX_OUTSTANDING].snapshot;
+    }
+
+    // Never roll back over memory a live slice still uses.
+    for (unsigned i = link->slice_first; i != h; i++) {
+        const wen_slice_slot *slot = &link->slices[i % WEN_MAX_OUTSTANDING];
+        if (!slot->released && slot->top > mark) mark = slot->top;
+    }
+
+    // Received bytes are retired in order, once the oldest slices are released.
+    while (link->slice_first != link->slice_next &&
+           link->slices[link->slice_first % WEN_MAX_OUTSTANDING].released) {
+        link->rx_held -= link->slices[link->slice_first % WEN_MAX_OUTSTANDING].held;
+        link->slice_first++;
+    }
+
+    if (link->slice_first == link->slice_next) mark = link->slice_arena_base;
+    if (mark <= link->arena.used) wen_arena_reset(&link->arena, mark);
+
+    if (link->rx_held == 0 && link->rx_len == 0) link->rx_off = 0;
+    wen__link_detach_idle(link);
+    wen__link_sync(link);
+}
+
+WENDEF wen_result wen_send(wen_link *link, unsigned opcode, const void *data, unsigned long len)
+{
+    if (!link || !link->codec) return WEN_ERR_STATE;
+    if (link->state == WEN_LINK_CLOSED) return WEN_ERR_CLOSED;
+    if (!link->codec->encode)  return WEN_ERR_UNSUPPORTED;
+
+    wen_result r = wen__link_attach(link);
+    if (r != WEN_OK) return r;
+    if (link->tx_len >= link->tx_cap) return WEN_ERR_OVERFLOW;
+
+    r = wen__tx_encode(link, opcode, data, len, false);
+    wen__link_sync(link);
+    return r;
+}
+
+WENDEF wen_result wen_send_ref(wen_link *link, unsigned opcode, const void *data, unsigned long len,
+                               void *user)
+{
+    if (!link || !link->codec) return WEN_ERR_STATE;
+    if (link->state == WEN_LINK_CLOSED) return WEN_ERR_CLOSED;
+    if (!link->codec->encode_header) return WEN_ERR_UNSUPPORTED;
+    if (len && !data) return WEN_ERR_STATE;
+    if (link->tx_ref_count == WEN_TX_REFS) return WEN_ERR_OVERFLOW;
+
+    wen_result r = wen__link_attach(link);
+    if (r != WEN_OK) return r;
+
+    r = wen__tx_encode(link, opcode, NULL, len, true);
+    if (r != WEN_OK) return r;
+
+    wen_tx_ref *ref = &link->tx_refs[(link->tx_ref_head + link->tx_ref_count) % WEN_TX_REFS];
+    ref->data   = data;
+    ref->len    = len;
+    ref->sent   = 0;
+    ref->before = link->tx_len - link->tx_ref_bytes;
+    ref->user   = user;
+
+    link->tx_ref_bytes += ref->before;
+    link->tx_ref_count++;
+    wen__link_sync(link);
+    return WEN_OK;
+}
+
+WENDEF wen_result wen_close(wen_link *link, unsigned code, unsigned opcode)
+{
+    if (!link) return WEN_ERR_STATE;
+    if (link->state >= WEN_LINK_CLOSED) return WEN_OK;
+    if (link->tx_len != 0 || link->tx_ref_count != 0) return WEN_ERR_STATE;
+
+    link->state = WEN_LINK_CLOSING;
+    if (link->codec && link->codec->encode && wen__link_attach(link) == WEN_OK)
+        (void)wen__tx_encode(link, opcode, &code, sizeof(code), false);
+
+    wen__link_sync(link);
+    return WEN_OK;
+}
+
+WENDEF bool wen_evq_push(wen_event_queue *q, const wen_event *ev)
+{
+    unsigned next = (q->tail + 1) % WEN_EVENT_QUEUE_CAP;
+    if (next == q->head) return 0;
+    q->q[q->tail] = *ev;
+    q->tail = next;
+    return 1;
+}
+
+WENDEF bool wen_evq_pop(wen_event_queue *q, wen_event *ev)
+{
+    if (q->head == q->tail) return 0;
+    *ev = q->q[q->head];
+    q->head = (q->head + 1) % WEN_EVENT_QUEUE_CAP;
+    return 1;
+}
+
+WENDEF unsigned wen_evq_len(const wen_event_queue *q)
+{
+    return (q->tail + WEN_EVENT_QUEUE_CAP - q->head) % WEN_EVENT_QUEUE_CAP;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+WENDEF wen_result wen_arena_init(wen_arena *arena, unsigned long size)
+{
+    if (!arena || size == 0) return WEN_ERR_STATE;
+
+#ifndef WEN_NO_MALLOC
+    arena->base = (unsigned char *)malloc(size);
+    if (!arena->base) return WEN_ERR_IO;
+    arena->owns_memory = true;
+#endif
+    arena->capacity = size;
+    arena->used = 0;
+    arena->pages = NULL;
+    arena->page = NULL;
+    arena->page_start = 0;
+
+    return WEN_OK;
+}
+
+WENDEF void wen_arena_bind(wen_arena *arena, void *mem, unsigned long size)
+{
+    arena->base = (unsigned char *)mem;
+    arena->capacity = size;
+    arena->used = 0;
+    arena->pages = NULL;
+    arena->page = NULL;
+    arena->page_start = 0;
+}
+
+WENDEF wen_result wen_buffer_pool_bind(wen_buffer_pool *pool, const wen_link_config *config,
+                                       void *mem, unsigned long size)
+{
+    if (!pool || !mem) return WEN_ERR_STATE;
+
+    memset(pool, 0, sizeof(*pool));
+    wen__link_config(config, &pool->config);
+    pool->config.mem = NULL;
+    pool->config.mem_size = 0;
+    pool->config.pool = NULL;
+    if (pool->config.rx_size < WEN_MIN_BUFFER || pool->config.tx_size < WEN_MIN_BUFFER) return WEN_ERR_STATE;
+
+    pool->block_size = WEN_ALIGN_UP(wen_link_mem_size(&pool->config), WEN_ARENA_ALIGN);
+    pool->mem = (unsigned char *)mem;
+    pool->count = (unsigned)(size / pool->block_size);
+    if (pool->count == 0) return WEN_ERR_OVERFLOW;
+
+    // Thread the free list through the blocks themselves, first block on top.
+    for (unsigned i = pool->count; i-- > 0;) {
+        void *block = pool->mem + (unsigned long)i * pool->block_size;
+        *(void **)block = pool->free_list;
+        pool->free_list = block;
+    }
+    pool->available = pool->count;
+
+    return WEN_OK;
+}
+
+WENDEF wen_result wen_buffer_pool_init(wen_buffer_pool *pool, const wen_link_config *config, unsigned count)
+{
+    if (!pool || count == 0) return WEN_ERR_STATE;
+
+#ifdef WEN_NO_MALLOC
+    WEN_UNUSED(config);
+    return WEN_ERR_UNSUPPORTED;
+#else
+    wen_link_config c;
+    wen__link_config(config, &c);
+    unsigned long size = WEN_ALIGN_UP(wen_link_mem_size(&c), WEN_ARENA_ALIGN) * count;
+
+    void *mem = malloc(size);
+    if (!mem) return WEN_ERR_IO;
+
+    wen_result r = wen_buffer_pool_bind(pool, config, mem, size);
+    if (r != WEN_OK) {
+        free(mem);
+        return r;
+    }
+    pool->owns_memory = true;
+    return WEN_OK;
+#endif
+}
+
+WENDEF void wen_buffer_pool_free(wen_buffer_pool *pool)
+{
+    if (!pool) return;
+    WEN_ASSERT(pool->available == pool->count && "wen_buffer_pool_free: blocks still lent out");
+
+#ifndef WEN_NO_MALLOC
+    if (pool->owns_memory && pool->mem)
+        free(pool->mem);
+#endif
+
+    memset(pool, 0, sizeof(*pool));
+}
+
+WENDEF unsigned wen_buffer_pool_available(const wen_buffer_pool *pool)
+{
+    return pool->available;
+}
+
+WENDEF void wen_arena_reset(wen_arena *a, wen_arena_snapshot mark)
+{
+    WEN_ASSERT(mark <= a->used && "wen_arena_reset: invalid snapshot");
+    if (mark > a->used) {
+        WEN_UNREACHABLE("wen_arena_reset");
+        return;
+    }
+
+    // Pages that hold nothing below the mark go back to the pool.
+    while (a->page && mark <= a->page_start) {
+        wen__arena_page *page = (wen__arena_page *)a->page;
+        unsigned char *prev = page->prev;
+        unsigned long prev_start = page->prev_start;
+
+        *(void **)a->page = a->pages->free_list;
+        a->pages->free_list = a->page;
+        a->pages->available++;
+
+        a->page = prev;
+        a->page_start = prev_start;
+    }
+
+    a->used = mark;
+}
+
+WENDEF void *wen_arena_alloc(wen_arena *a, unsigned long size)
+{
+    if (!a || !a->base || size == 0) return NULL;
+ 
+    unsigned long aligned_used = WEN_ALIGN_UP(a->used, WEN_ARENA_ALIGN);
+    unsigned long aligned_size = WEN_ALIGN_UP(size, WEN_ARENA_ALIGN);
+
+    // Bump within the current block: the base block or the newest page.
+    unsigned char *block = a->page ? a->page + WEN__ARENA_PAGE_HEADER : a->base;
+    unsigned long start = a->page ? a->page_start : 0;
+    unsigned long end = wen__arena_end(a);
+
+    if (aligned_used <= end && aligned_size <= end - aligned_used) {
+        a->used = aligned_used + aligned_size;
+        return block + (aligned_used - start);
+    }
+
+    // Out of room: chain a fresh page, skipping the tail of the current block.
+    if (!a->pages || !a->pages->free_list || aligned_size > wen__page_capacity(a->pages))
+        return NULL;
+
+    unsigned char *fresh = (unsigned char *)a->pages->free_list;
+    a->pages->free_list = *(void **)fresh;
+    a->pages->available--;
+
+    wen__arena_page *page = (wen__arena_page *)fresh;
+    page->prev = a->page;
+    page->prev_start = a->page_start;
+
+    a->page = fresh;
+    a->page_start = aligned_used;
+    a->used = aligned_used + aligned_size;
+    return fresh + WEN__ARENA_PAGE_HEADER;
+}
+
+WENDEF void *wen_arena_calloc(wen_arena *a, unsigned long count, unsigned long size)
+{
+    if (count == 0 || size == 0) return NULL;
+    if (count > (~0UL / size)) return NULL;
+
+    unsigned long total = count * size;
+    void *ptr = wen_arena_alloc(a, total);
+    if (!ptr) return NULL;
+
+    memset(ptr, 0, total);
+    return ptr;
+}
+
+WENDEF unsigned long wen_arena_remaining(const wen_arena *a)
+{
+    unsigned long end = wen__arena_end(a);
+    return a->used < end ? end - a->used : 0;
+}
+
+WENDEF bool wen_arena_can_alloc(const wen_arena *a, unsigned long size)
+{
+    unsigned long aligned_used = WEN_ALIGN_UP(a->used, WEN_ARENA_ALIGN);
+    unsigned long aligned_size = WEN_ALIGN_UP(size, WEN_ARENA_ALIGN);
+    unsigned long end = wen__arena_end(a);
+
+    if (aligned_used <= end && aligned_size <= end - aligned_used) return true;
+    return a->pages && a->pages->free_list && aligned_size <= wen__page_capacity(a->pages);
+}
+
+WENDEF unsigned long wen__arena_end(const wen_arena *a)
+{
+    return a->page ? a->page_start + wen__page_capacity(a->pages) : a->capacity;
+}
+
+WENDEF void wen_arena_chain(wen_arena *arena, wen_page_pool *pages)
+{
+    WEN_ASSERT(!arena->page && "wen_arena_chain: pages still chained");
+    arena->pages = pages;
+}
+
+WENDEF unsigned long wen__page_capacity(const wen_page_pool *pool)
+{
+    return pool->page_size - WEN__ARENA_PAGE_HEADER;
+}
+
+WENDEF wen_result wen_page_pool_bind(wen_page_pool *pool, unsigned long page_size, void *mem, unsigned long size)
+{
+    if (!pool || !mem) return WEN_ERR_STATE;
+
+    page_size = WEN_ALIGN_UP(page_size, WEN_ARENA_ALIGN);
+    if (page_size <= WEN__ARENA_PAGE_HEADER) return WEN_ERR_STATE;
+
+    memset(pool, 0, sizeof(*pool));
+    pool->page_size = page_size;
+    pool->mem = (unsigned char *)mem;
+    pool->count = (unsigned)(size / page_size);
+    if (pool->count == 0) return WEN_ERR_OVERFLOW;
+
+    for (unsigned i = pool->count; i-- > 0;) {
+        void *page = pool->mem + (unsigned long)i * page_size;
+        *(void **)page = pool->free_list;
+        pool->free_list = page;
+    }
+    pool->available = pool->count;
+
+    return WEN_OK;
+}
+
+WENDEF wen_result wen_page_pool_init(wen_page_pool *pool, unsigned long page_size, unsigned count)
+{
+    if (!pool || count == 0) return WEN_ERR_STATE;
+
+#ifdef WEN_NO_MALLOC
+    WEN_UNUSED(page_size);
+    return WEN_ERR_UNSUPPORTED;
+#else
+    unsigned long size = WEN_ALIGN_UP(page_size, WEN_ARENA_ALIGN) * count;
+    void *mem = malloc(size);
+    if (!mem) return WEN_ERR_IO;
+
+    wen_result r = wen_page_pool_bind(pool, page_size, mem, size);
+    if (r != WEN_OK) {
+        free(mem);
+        return r;
+    }
+    pool->owns_memory = true;
+    return WEN_OK;
+#endif
+}
+
+WENDEF void wen_page_pool_free(wen_page_pool *pool)
+{
+    if (!pool) return;
+    WEN_ASSERT(pool->available == pool->count && "wen_page_pool_free: pages still chained");
+
+#ifndef WEN_NO_MALLOC
+    if (pool->owns_memory && pool->mem)
+        free(pool->mem);
+#endif
+
+    memset(pool, 0, sizeof(*pool));
+}
+
+WENDEF unsigned wen_page_pool_available(const wen_page_pool *pool)
+{
+    return pool->available;
+}
+
+WENDEF wen_result wen_region_map(wen_region *region, unsigned long size, unsigned flags)
+{
+    if (!region || size == 0) return WEN_ERR_STATE;
+    memset(region, 0, sizeof(*region));
+
+#ifdef WEN__MAP_ANON
+    unsigned long page = (unsigned long)sysconf(_SC_PAGESIZE);
+    void *base = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+    // Explicit huge pages need a reserved pool; there may be none.
+    if (flags & WEN_REGION_HUGE_PAGES) {
+        unsigned long huge_size = WEN_ALIGN_UP(size, WEN_HUGE_PAGE_SIZE);
+        base = mmap(NULL, huge_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | WEN__MAP_ANON | MAP_HUGETLB, -1, 0);
+        if (base != MAP_FAILED) {
+            size = huge_size;
+            region->huge = true;
+        }
+    }
+#endif
+
+    if (base == MAP_FAILED) {
+        size = WEN_ALIGN_UP(size, page);
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | WEN__MAP_ANON, -1, 0);
+        if (base == MAP_FAILED) return WEN_ERR_IO;
+
+#ifdef MADV_HUGEPAGE
+        if (flags & WEN_REGION_HUGE_PAGES) (void)madvise(base, size, MADV_HUGEPAGE);
+#endif
+    }
+
+    if ((flags & WEN_REGION_LOCK) && mlock(base, size) != 0) {
+        munmap(base, size);
+        region->huge = false;
+        return WEN_ERR_IO;
+    }
+
+    // Take the page faults now rather than on a cold link's first burst.
+    if (flags & WEN_REGION_PREFAULT) {
+        for (unsigned long off = 0; off < size; off += page)
+            ((volatile unsigned char *)base)[off] = 0;
+    }
+
+    region->base = (unsigned char *)base;
+    region->size = size;
+    return WEN_OK;
+#else
+    WEN_UNUSED(flags);
+    return WEN_ERR_UNSUPPORTED;
+#endif
+}
+
+WENDEF void *wen_region_alloc(wen_region *region, unsigned long size)
+{
+    if (!region || !region->base || size == 0) return NULL;
+
+    unsigned long aligned_used = WEN_ALIGN_UP(region->used, WEN_ARENA_ALIGN);
+    if (aligned_used > region->size || size > region->size - aligned_used) return NULL;
+
+    region->used = aligned_used + size;
+    return region->base + aligned_used;
+}
+
+WENDEF void wen_region_unmap(wen_region *region)
+{
+    if (!region || !region->base) return;
+
+#ifdef WEN__MAP_ANON
+    munmap(region->base, region->size);
+#endif
+
+    memset(region, 0, sizeof(*region));
+}
+
+WENDEF wen_result wen_loop_init(wen_loop *loop)
+{
+    if (!loop) return WEN_ERR_STATE;
+
+    memset(loop, 0, sizeof(*loop));
+    loop->fd = -1;
+    wen_loop_set_quantum(loop, WEN_LOOP_QUANTUM, WEN_LOOP_QUANTUM_BYTES);
+
+#ifdef WEN__EPOLL
+    loop->fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->fd < 0) return WEN_ERR_IO;
+    return WEN_OK;
+#else
+    return WEN_ERR_UNSUPPORTED;
+#endif
+}
+
+WENDEF void wen_loop_free(wen_loop *loop)
+{
+    if (!loop) return;
+    WEN_ASSERT(loop->count == 0 && "wen_loop_free: links still registered");
+
+#ifdef WEN__URING
+    // The ring must not complete the poll of a loop that is gone.
+    if (loop->uring && loop->uring_polling) {
+        wen__uring_cancel(loop->uring, (unsigned long)loop | WEN__URING_LOOP);
+        while (loop->uring_polling && wen__uring_enter(loop->uring, 1, -1) >= 0)
+            wen__uring_reap(loop->uring);
+    }
+#endif
+
+#ifdef WEN__EPOLL
+    if (loop->fd >= 0) close(loop->fd);
+#endif
+
+    memset(loop, 0, sizeof(*loop));
+    loop->fd = -1;
+}
+
+WENDEF wen_result wen_loop_add(wen_loop *loop, wen_link *link, int fd)
+{
+    if (!loop || !link || fd < 0 || link->loop) return WEN_ERR_STATE;
+
+#ifdef WEN__EPOLL
+    // Ring connections only make progress on a loop that waits on their ring.
+    if (link->io.read == wen__uring_read && ((wen_uring_conn *)link->io.user)->ring != loop->uring)
+        return WEN_ERR_STATE;
+
+    // Ring connections report their own completions.
+    wen_uring_conn *conn = wen__loop_conn(loop, link);
+    if (conn) {
+        conn->link = link;
+    } else {
+        // Edge-triggered: a link is told once per change and reads until it runs dry.
+        struct epoll_event ee;
+        memset(&ee, 0, sizeof(ee));
+        ee.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ee.data.u64 = (unsigned long)link;
+        if (epoll_ctl(loop->fd, EPOLL_CTL_ADD, fd, &ee) != 0) return WEN_ERR_IO;
+    }
+
+    link->loop = loop;
+    link->loop_fd = fd;
+    loop->count++;
+    if (!link->drain_reads) wen_link_set_drain(link, WEN_LOOP_DRAIN_READS, 0);
+
+    // Pick up whatever arrived before the link was registered.
+    link->rx_drained = false;
+    link->loop_deficit = 0;
+    wen__loop_queue(loop, link);
+    return WEN_OK;
+#else
+    return WEN_ERR_UNSUPPORTED;
+#endif
+}
+
+WENDEF void wen_loop_remove(wen_loop *loop, wen_link *link)
+{
+    if (!loop || !link || link->loop != loop) return;
+
+    wen__loop_unqueue(loop, link);
+#ifdef WEN__EPOLL
+    wen_uring_conn *conn = wen__loop_conn(loop, link);
+    if (conn)
+        conn->link = NULL;
+    else
+        epoll_ctl(loop->fd, EPOLL_CTL_DEL, link->loop_fd, NULL);
+#endif
+
+    link->loop = NULL;
+    link->loop_fd = -1;
+    loop->count--;
+}
+
+WENDEF wen_result wen_loop_add_watch(wen_loop *loop, wen_loop_watch *watch)
+{
+    if (!loop || !watch || watch->fd < 0) return WEN_ERR_STATE;
+
+#ifdef WEN__EPOLL
+    // Level-triggered, and tagged in the low bit to tell it apart from a link.
+    struct epoll_event ee;
+    memset(&ee, 0, sizeof(ee));
+    ee.events = EPOLLIN;
+    ee.data.u64 = (unsigned long)watch | 1;
+    if (epoll_ctl(loop->fd, EPOLL_CTL_ADD, watch->fd, &ee) != 0) return WEN_ERR_IO;
+    return WEN_OK;
+#else
+    return WEN_ERR_UNSUPPORTED;
+#endif
+}
+
+WENDEF void wen_loop_remove_watch(wen_loop *loop, wen_loop_watch *watch)
+{
+    if (!loop || !watch) return;
+
+#ifdef WEN__EPOLL
+    epoll_ctl(loop->fd, EPOLL_CTL_DEL, watch->fd, NULL);
+#endif
+}
+
+WENDEF unsigned wen_loop_run(wen_loop *loop, wen_loop_event *out, unsigned cap, int timeout_ms)
+{
+    if (!loop || !out || cap == 0) return 0;
+
+    unsigned n = 0;
+
+    // Never sleep past the next deadline.
+    if (loop->timers) {
+        wen_timers_advance(loop->timers, wen_time_ms());
+        long next = wen_timers_next(loop->timers);
+        if (next >= 0 && (timeout_ms < 0 || next < timeout_ms)) timeout_ms = (int)next;
+    }
+
+#ifdef WEN__EPOLL
+    int got = 0;
+    struct epoll_event ready[WEN_LOOP_BATCH];
+    int wait = loop->ready_head ? 0 : timeout_ms;
+
+    if (loop->spin_us && wait != 0) {
+        // Right after activity, poll without sleeping until the window closes.
+        unsigned long long now = wen_time_us(), start = now;
+        unsigned long long limit = wait < 0 ? ~0ULL : (unsigned long long)wait * 1000;
+        while (now - loop->last_active < loop->spin_us && now - start < limit) {
+            got = wen__loop_wait(loop, ready, 0);
+            now = wen_time_us();
+            if (got || loop->ready_head) break;
+        }
+        loop->stats.spin_us += now - start;
+
+        if (got || loop->ready_head) {
+            loop->stats.spin_wakeups++;
+        } else {
+            if (wait > 0) wait = now - start >= limit ? 0 : wait - (int)((now - start) / 1000);
+            got = wen__loop_wait(loop, ready, wait);
+            loop->stats.sleep_us += wen_time_us() - now;
+            loop->stats.sleeps++;
+        }
+    } else {
+        got = wen__loop_wait(loop, ready, wait);
+    }
+
+    for (int i = 0; i < got; i++) {
+        unsigned long data = (unsigned long)ready[i].data.u64;
+
+        // Watches left unreported stay readable and come back next time.
+        if (data & 1) {
+            if (n == cap) continue;
+            memset(&out[n], 0, sizeof(out[n]));
+            out[n].watch = (wen_loop_watch *)(data & ~1UL);
+            n++;
+            continue;
+        }
+
+        wen_link *link = (wen_link *)data;
+        if (ready[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) link->rx_drained = false;
+        if (ready[i].events & EPOLLOUT) link->tx_blocked = false;
+        wen__loop_queue(loop, link);
+    }
+#else
+    WEN_UNUSED(timeout_ms);
+#endif
+
+    if (loop->timers) wen_timers_advance(loop->timers, wen_time_ms());
+
+    // Every link queued so far is polled once; links requeued meanwhile wait
+    // for the next call so that a busy link cannot starve the others.
+    unsigned pending = loop->ready_count;
+    wen_event evs[WEN_LOOP_BATCH];
+
+    while (pending-- > 0 && n < cap && loop->ready_head) {
+        wen_link *link = loop->ready_head;
+        wen__loop_unqueue(loop, link);
+
+        // Each visit earns a quantum; a link still in debt sits this round out.
+        unsigned long drain_bytes = link->drain_bytes;
+        if (loop->quantum_bytes) {
+            link->loop_deficit += (long)loop->quantum_bytes;
+            if (link->loop_deficit <= 0) {
+                wen__loop_queue(loop, link);
+                continue;
+            }
+            if (!drain_bytes || drain_bytes > (unsigned long)link->loop_deficit)
+                link->drain_bytes = (unsigned long)link->loop_deficit;
+        }
+
+        unsigned long tx_len = link->tx_len;
+        unsigned tx_refs = link->tx_ref_count;
+        unsigned room = cap - n < loop->quantum ? cap - n : loop->quantum;
+
+        loop->current = link;
+        unsigned polled = wen_poll_batch(link, evs, room);
+        loop->current = NULL;
+        link->drain_bytes = drain_bytes;
+
+        bool failed = false;
+        for (unsigned i = 0; i < polled; i++) {
+            out[n].link = link;
+            out[n].watch = NULL;
+            out[n].ev = evs[i];
+            n++;
+            if (evs[i].type == WEN_EV_ERROR) failed = true;
+            if (evs[i].type == WEN_EV_SLICE) link->loop_deficit -= (long)evs[i].as.slice.len;
+        }
+
+        // Credit is kept for input still waiting, and at most one quantum of
+        // it, so rounds spent on other events cannot bank a burst.
+        if (link->loop_deficit > 0 && link->rx_drained && !link->rx_len)
+            link->loop_deficit = 0;
+        else if (link->loop_deficit > (long)loop->quantum_bytes)
+            link->loop_deficit = (long)loop->quantum_bytes;
+
+        bool queued = link->evq.head != link->evq.tail;
+        if (link->state == WEN_LINK_CLOSED && !queued) {
+            wen_loop_remove(loop, link);
+            continue;
+        }
+
+        // Only a poll that got somewhere is repeated without a new notification.
+        bool progress = polled || link->tx_len != tx_len || link->tx_ref_count != tx_refs;
+        bool tx_left = (link->tx_len || link->tx_ref_count) && !link->tx_blocked;
+        if (queued || polled == room || (progress && !failed && (!link->rx_drained || tx_left)))
+            wen__loop_queue(loop, link);
+        else
+            link->loop_deficit = 0;
+    }
+
+    if (loop->spin_us && n) loop->last_active = wen_time_us();
+    return n;
+}
+
+WENDEF int wen__loop_wait(wen_loop *loop, void *ready, int timeout_ms)
+{
+#ifdef WEN__EPOLL
+    // With a ring, epoll is only asked once the ring saw it become readable.
+    int got = 0;
+    if (!loop->uring)
+        got = epoll_wait(loop->fd, ready, WEN_LOOP_BATCH, timeout_ms);
+    else if (wen__loop_uring_wait(loop, timeout_ms))
+        got = epoll_wait(loop->fd, ready, WEN_LOOP_BATCH, 0);
+    return got > 0 ? got : 0;
+#else
+    WEN_UNUSED(loop);
+    WEN_UNUSED(ready);
+    WEN_UNUSED(timeout_ms);
+    return 0;
+#endif
+}
+
+WENDEF void wen_loop_set_quantum(wen_loop *loop, unsigned events, unsigned long bytes)
+{
+    if (!loop) return;
+
+    loop->quantum = events && events < WEN_LOOP_BATCH ? events : WEN_LOOP_BATCH;
+    loop->quantum_bytes = bytes;
+}
+
+WENDEF void wen_loop_set_spin(wen_loop *loop, unsigned long spin_us)
+{
+    if (loop) loop->spin_us = spin_us;
+}
+
+WENDEF void wen_timers_init(wen_timers *timers, unsigned long tick_ms, unsigned long long now)
+{
+    if (!timers) return;
+
+    memset(timers, 0, sizeof(*timers));
+    timers->tick_ms = tick_ms ? tick_ms : WEN_TIMER_TICK_MS;
+    timers->now = now;
+    timers->ticks = now / timers->tick_ms;
+
+    for (unsigned l = 0; l < WEN__TIMER_LEVELS; l++) {
+        for (unsigned i = 0; i < WEN__TIMER_SLOTS; i++) {
+            wen_timer *head = &timers->slots[l][i];
+            head->next = head;
+            head->prev = head;
+        }
+    }
+}
+
+WENDEF void wen_link_set_timeouts(wen_link *link, unsigned long handshake_ms, unsigned long idle_ms,
+                                  unsigned long ping_ms)
+{
+    if (!link) return;
+
+    link->handshake_timeout = handshake_ms;
+    link->idle_timeout = idle_ms;
+    link->ping_interval = ping_ms;
+    if (link->timers) wen__timers_schedule(link->timers, link);
+}
+
+WENDEF void wen_timers_add(wen_timers *timers, wen_link *link)
+{
+    if (!timers || !link) return;
+    if (link->timers) wen_timers_remove(link);
+
+    link->timers = timers;
+    link->timer.next = NULL;
+    link->timer.prev = NULL;
+    link->started = timers->now;
+    link->last_rx = timers->now;
+    link->last_ping = timers->now;
+    timers->count++;
+    wen__timers_schedule(timers, link);
+}
+
+WENDEF void wen_timers_remove(wen_link *link)
+{
+    if (!link || !link->timers) return;
+
+    if (link->timer.next) wen__timers_unlink(link->timers, &link->timer);
+    link->timers->count--;
+    link->timers = NULL;
+}
+
+WENDEF unsigned wen_timers_advance(wen_timers *timers, unsigned long long now)
+{
+    if (!timers) return 0;
+
+    // A clock that went backwards is not waited for; the wheel goes on from
+    // where it is.
+    now += timers->skew;
+    if (now < timers->now) {
+        timers->skew += timers->now - now;
+        now = timers->now;
+    }
+
+    timers->now = now;
+    unsigned long long target = now / timers->tick_ms;
+    unsigned fired = 0;
+
+    while (timers->ticks < target) {
+        unsigned long long pending = 0;
+        for (unsigned l = 0; l < WEN__TIMER_LEVELS; l++) pending |= timers->used[l];
+        if (!pending) {
+            timers->ticks = target;
+            break;
+        }
+
+        // Jump straight to the next wrap while the first level is empty.
+        unsigned long long wrap = timers->ticks | (WEN__TIMER_SLOTS - 1);
+        if (!timers->used[0] && wrap < target) timers->ticks = wrap;
+
+        unsigned long long t = ++timers->ticks;
+        unsigned slot = (unsigned)(t & (WEN__TIMER_SLOTS - 1));
+        if (slot == 0) wen__timers_cascade(timers, 1);
+
+        wen_timer *head = &timers->slots[0][slot];
+        while (head->next != head) {
+            wen_timer *timer = head->next;
+            wen__timers_unlink(timers, timer);
+            fired += wen__timers_fire(timers, (wen_link *)((char *)timer - offsetof(wen_link, timer)));
+        }
+    }
+    return fired;
+}
+
+WENDEF long wen_timers_next(const wen_timers *timers)
+{
+    if (!timers) return -1;
+
+    bool found = false;
+    unsigned long long best = 0;
+    for (unsigned l = 0; l < WEN__TIMER_LEVELS; l++) {
+        unsigned long long used = timers->used[l];
+        if (!used) continue;
+
+        // Distance from the current slot to the next used one, 1 to 64.
+        unsigned shift = WEN__TIMER_BITS * l;
+        unsigned cur = (unsigned)((timers->ticks >> shift) & (WEN__TIMER_SLOTS - 1));
+        unsigned long long rot = cur == WEN__TIMER_SLOTS - 1
+            ? used
+            : (used >> (cur + 1)) | (used << (WEN__TIMER_SLOTS - 1 - cur));
+        unsigned long long start = ((timers->ticks >> shift) + wen__ctz64(rot) + 1) << shift;
+
+        if (!found || start < best) best = start;
+        found = true;
+    }
+    if (!found) return -1;
+
+    unsigned long long at = best * timers->tick_ms;
+    return at > timers->now ? (long)(at - timers->now) : 0;
+}
+
+WENDEF void wen_loop_set_timers(wen_loop *loop, wen_timers *timers)
+{
+    if (loop) loop->timers = timers;
+}
+
+WENDEF unsigned long long wen_time_ms(void)
+{
+    return wen_time_us() / 1000;
+}
+
+WENDEF unsigned long long wen_time_us(void)
+{
+#if defined(_WIN32)
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER count;
+    if (!freq.QuadPart) QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+
+    unsigned long long c = (unsigned long long)count.QuadPart, hz = (unsigned long long)freq.QuadPart;
+    return c / hz * 1000000ULL + c % hz * 1000000ULL / hz;
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000ULL + (unsigned long long)ts.tv_nsec / 1000ULL;
+#elif defined(TIME_UTC)
+    // Calendar time may step; wen_timers_advance() copes with it going back.
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (unsigned long long)ts.tv_sec * 1000000ULL + (unsigned long long)ts.tv_nsec / 1000ULL;
+#else
+    return (unsigned long long)time(NULL) * 1000000ULL;
+#endif
+}
+
+WENDEF void wen__timers_schedule(wen_timers *timers, wen_link *link)
+{
+    if (link->timer.next) wen__timers_unlink(timers, &link->timer);
+
+    // The earliest deadline; the others are checked when it fires.
+    unsigned long long due = wen__link_deadline(link);
+    if (!due) return;
+
+    unsigned long long tick = (due + timers->tick_ms - 1) / timers->tick_ms;
+    link->timer.expires = tick > timers->ticks ? tick : timers->ticks + 1;
+    wen__timers_link(timers, &link->timer);
+}
+
+WENDEF unsigned long long wen__link_deadline(const wen_link *link)
+{
+    if (link->state == WEN_LINK_CLOSED) return 0;
+
+    unsigned long long due = 0;
+    if (link->state <= WEN_LINK_HANDSHAKE && link->handshake_timeout)
+        due = link->started + link->handshake_timeout;
+    if (link->idle_timeout && (!due || link->last_rx + link->idle_timeout < due))
+        due = link->last_rx + link->idle_timeout;
+    if (link->ping_interval && (!due || link->last_ping + link->ping_interval < due))
+        due = link->last_ping + link->ping_interval;
+    return due;
+}
+
+WENDEF void wen__timers_link(wen_timers *timers, wen_timer *timer)
+{
+    if (timer->expires < timers->ticks) timer->expires = timers->ticks;
+
+    // Deadlines past the top level wait in its farthest slot.
+    unsigned long long max = 1ULL << (WEN__TIMER_BITS * WEN__TIMER_LEVELS);
+    unsigned long long delta = timer->expires - timers->ticks;
+    if (delta >= max) {
+        delta = max - 1;
+        timer->expires = timers->ticks + delta;
+    }
+
+    unsigned level = 0;
+    while (level < WEN__TIMER_LEVELS - 1 && delta >= 1ULL << (WEN__TIMER_BITS * (level + 1))) level++;
+    unsigned slot = (unsigned)((timer->expires >> (WEN__TIMER_BITS * level)) & (WEN__TIMER_SLOTS - 1));
+
+    wen_timer *head = &timers->slots[level][slot];
+    timer->next = head;
+    timer->prev = head->prev;
+    head->prev->next = timer;
+    head->prev = timer;
+    timer->slot = level * WEN__TIMER_SLOTS + slot;
+    timers->used[level] |= 1ULL << slot;
+}
+
+WENDEF void wen__timers_unlink(wen_timers *timers, wen_timer *timer)
+{
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+
+    // Only the head is left.
+    if (timer->next == timer->prev)
+        timers->used[timer->slot / WEN__TIMER_SLOTS] &= ~(1ULL << (timer->slot % WEN__TIMER_SLOTS));
+
+    timer->next = NULL;
+    timer->prev = NULL;
+}
+
+WENDEF void wen__timers_cascade(wen_timers *timers, unsigned level)
+{
+    if (level >= WEN__TIMER_LEVELS) return;
+
+    // Higher levels first, so that their timers can still drop into this one.
+    unsigned slot = (unsigned)((timers->ticks >> (WEN__TIMER_BITS * level)) & (WEN__TIMER_SLOTS - 1));
+    if (slot == 0) wen__timers_cascade(timers, level + 1);
+
+    wen_timer *head = &timers->slots[level][slot];
+    while (head->next != head) {
+        wen_timer *timer = head->next;
+        wen__timers_unlink(timers, timer);
+        wen__timers_link(timers, timer);
+    }
+}
+
+WENDEF unsigned wen__timers_fire(wen_timers *timers, wen_link *link)
+{
+    unsigned long long now = timers->now;
+    unsigned fired = 0;
+    wen_event ev = { .type = WEN_EV_TIMEOUT };
+
+    // A full event queue leaves the deadline due, and it is retried next tick.
+    if (link->state <= WEN_LINK_HANDSHAKE && link->handshake_timeout &&
+        now >= link->started + link->handshake_timeout) {
+        ev.as.timeout = WEN_TIMEOUT_HANDSHAKE;
+        if (wen_evq_push(&link->evq, &ev)) {
+            link->handshake_timeout = 0;
+            fired++;
+        }
+    }
+    if (link->idle_timeout && now >= link->last_rx + link->idle_timeout) {
+        ev.as.timeout = WEN_TIMEOUT_IDLE;
+        if (wen_evq_push(&link->evq, &ev)) {
+            link->last_rx = now;
+            fired++;
+        }
+    }
+    if (link->ping_interval && now >= link->last_ping + link->ping_interval) {
+        ev.as.timeout = WEN_TIMEOUT_PING;
+        if (link->state != WEN_LINK_OPEN) {
+            link->last_ping = now;
+        } else if (wen_evq_push(&link->evq, &ev)) {
+            link->last_ping = now;
+            fired++;
+        }
+    }
+
+    wen__timers_schedule(timers, link);
+    if (fired) wen__link_sync(link);
+    return fired;
+}
+
+WENDEF unsigned wen__ctz64(unsigned long long x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return (unsigned)__builtin_ctzll(x);
+#else
+    unsigned n = 0;
+    while (!(x & 1)) {
+        x >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+WENDEF wen_result wen_runtime_start(wen_runtime *rt, const wen_runtime_config *config)
 {
-    if (link->tx_len == 0) return -1;
+    if (!rt || !config || !config->on_accept || !config->on_event) return WEN_ERR_STATE;
 
-    long nw = link->io.write(link->io.user, link->tx_buf, link->tx_len);
-    if (nw < 0) {
-        ev->type = WEN_EV_ERROR;
-        ev->as.error = WEN_ERR_IO;
-        return true;
-    }
-    if ((unsigned long)nw < link->tx_len) {
-        memmove(link->tx_buf, link->tx_buf + nw, link->tx_len - (unsigned long)nw);
-        link->tx_len -= (unsigned long)nw;
-    } else {
-        link->tx_len = 0;
+    memset(rt, 0, sizeof(*rt));
+    rt->config = *config;
+    if (rt->config.backlog <= 0) rt->config.backlog = WEN_RUNTIME_BACKLOG;
+
+#if defined(WEN__RUNTIME) && defined(WEN__EPOLL) && !defined(WEN_NO_MALLOC)
+#    ifndef WEN__PIN
+    if (config->pin) return WEN_ERR_UNSUPPORTED;
+#    endif
+
+    rt->count = config->shards;
+    if (rt->count == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        rt->count = cpus > 0 ? (unsigned)cpus : 1;
     }
-    if (!link->close_queued && link->state >= WEN_LINK_CLOSING && !link->slice_outstanding) {
-        wen_event cev = { .type = WEN_EV_CLOSE };
-        wen_evq_push(&link->evq, &cev);
-        link->close_queued = true;
+
+    rt->shards = (wen_shard *)calloc(rt->count, sizeof(wen_shard));
+    rt->threads = calloc(rt->count, sizeof(pthread_t));
+    if (!rt->shards || !rt->threads) {
+        wen_runtime_stop(rt);
+        return WEN_ERR_IO;
     }
-    return false;
-}
 
-WENDEF unsigned wen__poll_read_rx(wen_link *link, wen_event *ev)
-{
-    if (link->rx_len < WEN_RX_BUFFER) {
-        long nread = link->io.read(link->io.user, link->rx_buf + link->rx_len, WEN_RX_BUFFER - link->rx_len);
+    for (unsigned i = 0; i < rt->count; i++) {
+        wen_shard *shard = &rt->shards[i];
+        shard->index = i;
+        shard->cpu = -1;
+        shard->runtime = rt;
+        shard->loop.fd = -1;
+        shard->listener.fd = -1;
+        shard->wakeup.fd = -1;
+    }
 
-        if (nread < 0) {
-            ev->type = WEN_EV_ERROR;
-            ev->as.error = WEN_ERR_IO;
-            return true;
+    for (unsigned i = 0; i < rt->count; i++) {
+        wen_shard *shard = &rt->shards[i];
+        wen_timers_init(&shard->timers, config->timer_tick_ms, wen_time_ms());
+        shard->listener.fd = wen__runtime_listen(rt);
+        shard->wakeup.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (shard->listener.fd < 0 || shard->wakeup.fd < 0 || wen_loop_init(&shard->loop) != WEN_OK ||
+            wen_loop_add_watch(&shard->loop, &shard->listener) != WEN_OK ||
+            wen_loop_add_watch(&shard->loop, &shard->wakeup) != WEN_OK) {
+            wen_runtime_stop(rt);
+            return WEN_ERR_IO;
         }
+        wen_loop_set_timers(&shard->loop, &shard->timers);
+        wen_loop_set_spin(&shard->loop, config->spin_us);
+    }
 
-        if (nread == 0) {
-            if (link->state < WEN_LINK_CLOSING)
-                link->state = WEN_LINK_CLOSING;
-
-            if (!link->close_queued && !link->slice_outstanding) {
-                wen_event cev = { .type = WEN_EV_CLOSE };
-                wen_evq_push(&link->evq, &cev);
-                link->close_queued = true;
+#    ifdef WEN__PIN
+    // Shards take turns over the CPUs the process is allowed on, which need
+    // not be the first online ones under taskset or a cgroup.
+    if (config->pin) {
+        cpu_set_t allowed;
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0) {
+            wen_runtime_stop(rt);
+            return WEN_ERR_IO;
+        }
+        unsigned allowed_count = (unsigned)CPU_COUNT(&allowed);
+        for (unsigned i = 0; i < rt->count; i++) {
+            unsigned nth = i % allowed_count;
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (!CPU_ISSET(cpu, &allowed)) continue;
+                if (nth-- == 0) {
+                    rt->shards[i].cpu = cpu;
+                    break;
+                }
             }
-
-            return false;
         }
+    }
+#    endif
 
-        link->rx_len += (unsigned long)nread;
+    pthread_t *threads = (pthread_t *)rt->threads;
+    for (unsigned i = 0; i < rt->count; i++) {
+        if (pthread_create(&threads[i], NULL, wen__shard_main, &rt->shards[i]) != 0) {
+            wen_runtime_stop(rt);
+            return WEN_ERR_IO;
+        }
+        rt->started++;
     }
-    return -1;
+    return WEN_OK;
+#else
+    return WEN_ERR_UNSUPPORTED;
+#endif
 }
 
-WENDEF bool wen__poll_handshake(wen_link *link, wen_event *ev)
+WENDEF void wen_runtime_stop(wen_runtime *rt)
 {
-    unsigned long consumed = 0;
-    unsigned long out_len = 0;
+    if (!rt) return;
 
-    wen_handshake_status hs =
-        link->codec->handshake(
-            link->codec_state,
-            link->rx_buf, link->rx_len,
-            &consumed,
-            link->tx_buf, WEN_TX_BUFFER,
-            &out_len);
+#if defined(WEN__RUNTIME) && defined(WEN__EPOLL) && !defined(WEN_NO_MALLOC)
+    __atomic_store_n(&rt->stopping, 1, __ATOMIC_RELEASE);
 
-    if (out_len) link->tx_len = out_len;
+    pthread_t *threads = (pthread_t *)rt->threads;
+    for (unsigned i = 0; i < rt->started; i++) {
+        unsigned long long one = 1;
+        if (write(rt->shards[i].wakeup.fd, &one, sizeof(one)) < 0) {}
+        pthread_join(threads[i], NULL);
+    }
 
-    memmove(link->rx_buf, link->rx_buf + consumed, link->rx_len - consumed);
-    link->rx_len -= consumed;
+    for (unsigned i = 0; rt->shards && i < rt->count; i++) {
+        wen_shard *shard = &rt->shards[i];
+        if (shard->loop.fd >= 0) {
+            wen_loop_remove_watch(&shard->loop, &shard->listener);
+            wen_loop_remove_watch(&shard->loop, &shard->wakeup);
+            wen_loop_free(&shard->loop);
+        }
+        if (shard->listener.fd >= 0) close(shard->listener.fd);
+        if (shard->wakeup.fd >= 0) close(shard->wakeup.fd);
+    }
 
-    if (hs == WEN_HANDSHAKE_COMPLETE) {
-        link->state = WEN_LINK_OPEN;
-        ev->type = WEN_EV_OPEN;
-        return true;
+    free(rt->shards);
+    free(rt->threads);
+#endif
+
+    memset(rt, 0, sizeof(*rt));
+}
+
+WENDEF int wen__runtime_listen(wen_runtime *rt)
+{
+#ifdef WEN__RUNTIME
+    const wen_runtime_config *c = &rt->config;
+
+    struct sockaddr_storage ss;
+    socklen_t len;
+    memset(&ss, 0, sizeof(ss));
+
+    if (c->host && strchr(c->host, ':')) {
+        struct sockaddr_in6 *a = (struct sockaddr_in6 *)&ss;
+        a->sin6_family = AF_INET6;
+        a->sin6_port = htons(rt->port ? rt->port : c->port);
+        if (inet_pton(AF_INET6, c->host, &a->sin6_addr) != 1) return -1;
+        len = sizeof(*a);
+    } else {
+        struct sockaddr_in *a = (struct sockaddr_in *)&ss;
+        a->sin_family = AF_INET;
+        a->sin_port = htons(rt->port ? rt->port : c->port);
+        a->sin_addr.s_addr = htonl(INADDR_ANY);
+        if (c->host && inet_pton(AF_INET, c->host, &a->sin_addr) != 1) return -1;
+        len = sizeof(*a);
     }
 
-    if (hs == WEN_HANDSHAKE_FAILED) {
-        ev->type = WEN_EV_ERROR;
-        ev->as.error = WEN_ERR_PROTOCOL;
-        return true;
+    int fd = socket(ss.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    int one = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) != 0 ||
+        bind(fd, (struct sockaddr *)&ss, len) != 0 || listen(fd, c->backlog) != 0) {
+        close(fd);
+        return -1;
     }
 
-    return false;
+    // The first listener fixes the port the others join.
+    if (!rt->port) {
+        len = sizeof(ss);
+        if (getsockname(fd, (struct sockaddr *)&ss, &len) != 0) {
+            close(fd);
+            return -1;
+        }
+        rt->port = ntohs(ss.ss_family == AF_INET6 ? ((struct sockaddr_in6 *)&ss)->sin6_port
+                                                  : ((struct sockaddr_in *)&ss)->sin_port);
+    }
+    return fd;
+#else
+    WEN_UNUSED(rt);
+    return -1;
+#endif
 }
 
-WENDEF bool wen__poll_decode(wen_link *link, wen_event *ev)
+WENDEF void *wen__shard_main(void *arg)
 {
-    unsigned long slice_length =
-        link->frame_len ? WEN_MIN(link->frame_len, WEN_MAX_SLICE) : WEN_MIN(link->rx_len, WEN_MAX_SLICE);
-
-    // Decode is codec-specific and opaque
-    if (link->codec->decode) {
-        wen_result r = link->codec->decode(link->codec_state, link->rx_buf, slice_length);
-        if (r != WEN_OK) {
-            ev->type = WEN_EV_ERROR;
-            ev->as.error = r;
-            return true;
+#if defined(WEN__RUNTIME) && defined(WEN__EPOLL)
+    wen_shard *shard = (wen_shard *)arg;
+    wen_runtime *rt = shard->runtime;
+    const wen_runtime_config *c = &rt->config;
+
+#    ifdef WEN__PIN
+    // A shard that could not be pinned runs anyway; on_start() can tell.
+    if (shard->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(shard->cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) shard->cpu = -1;
+    }
+#    endif
+
+    if (c->on_start) c->on_start(shard);
+
+    wen_loop_event events[WEN_LOOP_BATCH];
+    while (!__atomic_load_n(&rt->stopping, __ATOMIC_ACQUIRE)) {
+        unsigned n = wen_loop_run(&shard->loop, events, WEN_LOOP_BATCH, -1);
+
+        for (unsigned i = 0; i < n; i++) {
+            if (events[i].watch == &shard->listener) {
+                wen__shard_accept(shard);
+            } else if (events[i].watch == &shard->wakeup) {
+                unsigned long long count;
+                if (read(shard->wakeup.fd, &count, sizeof(count)) < 0) {}
+            } else {
+                c->on_event(shard, &events[i]);
+            }
         }
     }
 
-    slice_length = WEN_MIN3(slice_length, WEN_MAX_SLICE, link->rx_len);
+    if (c->on_stop) c->on_stop(shard);
+#else
+    WEN_UNUSED(arg);
+#endif
+    return NULL;
+}
 
-    // Create slice event
-    if (slice_length == 0) return false;
-    WEN_ASSERT(!link->slice_outstanding && "wen_poll: previous slice not released");
-    wen_arena_snapshot snap = link->arena.used;
-    void *dst = wen_arena_alloc(&link->arena, slice_length);
-    if (!dst) {
-        ev->type = WEN_EV_ERROR;
-        ev->as.error = WEN_ERR_OVERFLOW;
-        return true;
+WENDEF void wen__shard_accept(wen_shard *shard)
+{
+#ifdef WEN__RUNTIME
+    // Level-triggered: whatever is left over is reported again.
+    for (unsigned i = 0; i < WEN_LOOP_BATCH; i++) {
+#    ifdef _GNU_SOURCE
+        int fd = accept4(shard->listener.fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#    else
+        int fd = accept(shard->listener.fd, NULL, NULL);
+        if (fd >= 0) fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+#    endif
+        if (fd < 0) return;
+        shard->runtime->config.on_accept(shard, fd);
     }
+#else
+    WEN_UNUSED(shard);
+#endif
+}
 
-    memcpy(dst, link->rx_buf, slice_length);
+WENDEF wen_result wen_loop_init_uring(wen_loop *loop, wen_uring *ring)
+{
+    if (!ring || ring->fd < 0) return WEN_ERR_STATE;
 
-    wen_event sev = {
-        .type              = WEN_EV_SLICE,
-        .as.slice.data     = dst,
-        .as.slice.len      = slice_length,
-        .as.slice.flags    = WEN_SLICE_BEGIN | WEN_SLICE_END,
-        .as.slice.snapshot = snap,
-    };
+    wen_result r = wen_loop_init(loop);
+    if (r != WEN_OK) return r;
 
-    // Enqueue event
-    if (!wen_evq_push(&link->evq, &sev)) {
-        wen_arena_reset(&link->arena, snap);
-        ev->type = WEN_EV_ERROR;
-        ev->as.error = WEN_ERR_OVERFLOW;
-        return true;
-    }
+#ifdef WEN__URING
+    loop->uring = ring;
+    return WEN_OK;
+#else
+    wen_loop_free(loop);
+    return WEN_ERR_UNSUPPORTED;
+#endif
+}
 
-    memmove(link->rx_buf,
-            link->rx_buf + slice_length,
-            link->rx_len - slice_length);
-    link->rx_len -= slice_length;
-    link->slice_outstanding = true;
+WENDEF wen_uring_conn *wen__loop_conn(const wen_loop *loop, const wen_link *link)
+{
+#ifdef WEN__URING
+    if (loop->uring && link->io.read == wen__uring_read) return (wen_uring_conn *)link->io.user;
+#else
+    WEN_UNUSED(loop);
+    WEN_UNUSED(link);
+#endif
+    return NULL;
+}
 
-    *ev = sev;
+WENDEF bool wen__loop_uring_wait(wen_loop *loop, int timeout_ms)
+{
+#ifdef WEN__URING
+    wen_uring *ring = loop->uring;
+
+    // A one-shot poll on the epoll instance, rearmed once epoll was drained,
+    // wakes the ring for watches and plain links.
+    if (!loop->uring_polling) {
+        struct io_uring_sqe *sqe = (struct io_uring_sqe *)wen__uring_sqe(ring);
+        if (sqe) {
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->fd = loop->fd;
+            sqe->poll32_events = POLLIN;
+            sqe->user_data = (unsigned long)loop | WEN__URING_LOOP;
+            loop->uring_polling = true;
+        }
+    }
 
-    if (link->frame_len) link->frame_len -= slice_length;
+    // Submits everything the links queued and reaps their completions in one go.
+    wen__uring_enter(ring, loop->ready_head || loop->uring_epoll ? 0 : 1, timeout_ms);
+    wen__uring_reap(ring);
+
+    bool epoll = loop->uring_epoll;
+    loop->uring_epoll = false;
+    return epoll;
+#else
+    WEN_UNUSED(loop);
+    WEN_UNUSED(timeout_ms);
     return false;
+#endif
 }
 
-WENDEF void wen_release(wen_link *link, wen_slice slice)
+WENDEF wen_result wen_uring_init(wen_uring *ring, unsigned entries, unsigned buffers,
+                                 unsigned long buffer_size)
 {
-    WEN_ASSERT(link && "wen_release: link is NULL");
-    WEN_ASSERT(link->slice_outstanding && "wen_release called with no outstanding slice");
+    if (!ring) return WEN_ERR_STATE;
+
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+
+#ifdef WEN__URING
+    if (buffers == 0 || buffers > 32768 || (buffers & (buffers - 1))) return WEN_ERR_STATE;
+    if (entries == 0) entries = WEN_URING_ENTRIES;
+    if (buffer_size == 0) buffer_size = WEN_URING_BUFFER;
+    buffer_size = WEN_ALIGN_UP(buffer_size, 64);
+
+    // Multishot receives may complete many times per submission.
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = entries * 4;
+
+    int fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (fd < 0) return errno == ENOSYS || errno == EPERM ? WEN_ERR_UNSUPPORTED : WEN_ERR_IO;
+    ring->fd = fd;
+
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_EXT_ARG)) {
+        wen_uring_free(ring);
+        return WEN_ERR_UNSUPPORTED;
+    }
 
-    wen_arena_reset(&link->arena, slice.snapshot);
-    link->slice_outstanding = false;
-}
+    unsigned long sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    unsigned long cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    ring->rings_size = sq_size > cq_size ? sq_size : cq_size;
+    ring->rings = mmap(NULL, ring->rings_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       fd, IORING_OFF_SQ_RING);
+    ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      fd, IORING_OFF_SQES);
+    if (ring->rings == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        if (ring->rings == MAP_FAILED) ring->rings = NULL;
+        if (ring->sqes == MAP_FAILED) ring->sqes = NULL;
+        wen_uring_free(ring);
+        return WEN_ERR_IO;
+    }
 
-WENDEF wen_result wen_send(wen_link *link, unsigned opcode, const void *data, unsigned long len)
-{
-    if (!link || !link->codec) return WEN_ERR_STATE;
-    if (!link->codec->encode)  return WEN_ERR_UNSUPPORTED;
-    if (link->tx_len >= WEN_TX_BUFFER) return WEN_ERR_OVERFLOW;
+    unsigned char *base = (unsigned char *)ring->rings;
+    ring->sq_head = (unsigned *)(base + p.sq_off.head);
+    ring->sq_tail = (unsigned *)(base + p.sq_off.tail);
+    ring->sq_array = (unsigned *)(base + p.sq_off.array);
+    ring->sq_mask = *(unsigned *)(base + p.sq_off.ring_mask);
+    ring->cq_head = (unsigned *)(base + p.cq_off.head);
+    ring->cq_tail = (unsigned *)(base + p.cq_off.tail);
+    ring->cqes = base + p.cq_off.cqes;
+    ring->cq_mask = *(unsigned *)(base + p.cq_off.ring_mask);
+
+    // The provided buffer ring must be page aligned, so it goes first.
+    unsigned long ring_bytes = WEN_ALIGN_UP(buffers * sizeof(struct io_uring_buf), 4096UL);
+    unsigned long slab_bytes = 2UL * buffers * buffer_size;
+    ring->mem_size = ring_bytes + slab_bytes + 3UL * buffers * sizeof(unsigned);
+    ring->mem = mmap(NULL, ring->mem_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | WEN__MAP_ANON, -1, 0);
+    if (ring->mem == MAP_FAILED) {
+        ring->mem = NULL;
+        wen_uring_free(ring);
+        return WEN_ERR_IO;
+    }
 
-    unsigned long out_len = 0;
+    ring->buf_ring = ring->mem;
+    ring->slab = (unsigned char *)ring->mem + ring_bytes;
+    ring->buffer_size = buffer_size;
+    ring->buffers = buffers;
+    ring->buf_len = (unsigned *)(ring->slab + slab_bytes);
+    ring->buf_next = ring->buf_len + buffers;
+    ring->send_free = ring->buf_next + buffers;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (unsigned long)ring->buf_ring;
+    reg.ring_entries = buffers;
+    reg.bgid = 0;
+    if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+        wen_uring_free(ring);
+        return WEN_ERR_UNSUPPORTED;
+    }
 
-    wen_result r = link->codec->encode(
-        link->codec_state,
-        opcode,
-        data,
-        len,
-        link->tx_buf + link->tx_len,
-        WEN_TX_BUFFER - link->tx_len,
-        &out_len);
+    for (unsigned i = 0; i < buffers; i++) {
+        wen__uring_recycle(ring, i);
+        ring->send_free[i] = buffers + i;
+    }
+    ring->send_available = buffers;
+    return WEN_OK;
+#else
+    WEN_UNUSED(entries);
+    WEN_UNUSED(buffers);
+    WEN_UNUSED(buffer_size);
+    return WEN_ERR_UNSUPPORTED;
+#endif
+}
 
-    if (r != WEN_OK) return r;
+WENDEF void wen_uring_free(wen_uring *ring)
+{
+    if (!ring) return;
+    WEN_ASSERT(ring->send_available == ring->buffers && "wen_uring_free: connections still open");
+
+#ifdef WEN__URING
+    if (ring->fd >= 0) close(ring->fd);
+    if (ring->rings) munmap(ring->rings, ring->rings_size);
+    if (ring->sqes) munmap(ring->sqes, ring->sqes_size);
+    if (ring->mem) munmap(ring->mem, ring->mem_size);
+#endif
 
-    link->tx_len += out_len;
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+WENDEF wen_result wen_uring_conn_init(wen_uring_conn *conn, wen_uring *ring, int fd, wen_io *io)
+{
+    if (!conn || !ring || ring->fd < 0 || fd < 0 || !io) return WEN_ERR_STATE;
+    if (ring->send_available == 0) return WEN_ERR_OVERFLOW;
+
+    memset(conn, 0, sizeof(*conn));
+    conn->ring = ring;
+    conn->fd = fd;
+    conn->rx_head = WEN__URING_NONE;
+    conn->rx_tail = WEN__URING_NONE;
+    conn->tx_buf = ring->send_free[--ring->send_available];
+
+    memset(io, 0, sizeof(*io));
+    io->user = conn;
+    io->read = wen__uring_read;
+    io->write = wen__uring_write;
     return WEN_OK;
 }
 
-WENDEF wen_result wen_close(wen_link *link, unsigned code, unsigned opcode)
+WENDEF void wen_uring_conn_close(wen_uring_conn *conn)
 {
-    if (!link) return WEN_ERR_STATE;
-    if (link->state >= WEN_LINK_CLOSED) return WEN_OK;
-    if (link->tx_len != 0) return WEN_ERR_STATE;
+    if (!conn || !conn->ring) return;
+
+    wen_uring *ring = conn->ring;
+    if (conn->link && conn->link->loop) wen_loop_remove(conn->link->loop, conn->link);
+    conn->closing = true;
+
+    // Blocking is only safe once both cancellations are queued; with the
+    // submission queue full they are retried after a short wait.
+    bool rx = false, tx = false;
+    while (conn->inflight) {
+        if (!rx) rx = wen__uring_cancel(ring, (unsigned long)conn | WEN__URING_RECV);
+        if (!tx) tx = wen__uring_cancel(ring, (unsigned long)conn | WEN__URING_SEND);
+        if (wen__uring_enter(ring, 1, rx && tx ? -1 : 1) < 0) break;
+        wen__uring_reap(ring);
+    }
 
-    link->state = WEN_LINK_CLOSING;
-    if (link->codec && link->codec->encode) {
-        unsigned long out_len = 0;
-        if (link->codec->encode(
-                link->codec_state,
-                opcode,
-                &code, sizeof(code),
-                link->tx_buf, WEN_TX_BUFFER,
-                &out_len) == WEN_OK) {
-            link->tx_len = out_len;
-        }
+    while (conn->rx_head != WEN__URING_NONE) {
+        unsigned id = conn->rx_head;
+        conn->rx_head = ring->buf_next[id];
+        wen__uring_recycle(ring, id);
     }
+    ring->send_free[ring->send_available++] = conn->tx_buf;
 
-    return WEN_OK;
+    memset(conn, 0, sizeof(*conn));
+    conn->fd = -1;
 }
 
-WENDEF bool wen_evq_push(wen_event_queue *q, const wen_event *ev)
+WENDEF long wen_uring_run(wen_uring *ring, int timeout_ms)
 {
-    unsigned next = (q->tail + 1) % WEN_EVENT_QUEUE_CAP;
-    if (next == q->head) return 0;
-    q->q[q->tail] = *ev;
-    q->tail = next;
-    return 1;
+    if (!ring || ring->fd < 0) return -1;
+
+    if (wen__uring_enter(ring, timeout_ms ? 1 : 0, timeout_ms) < 0) return -1;
+    return (long)wen__uring_reap(ring);
 }
 
-WENDEF bool wen_evq_pop(wen_event_queue *q, wen_event *ev)
+WENDEF long wen__uring_read(void *user, void *buf, unsigned long len)
 {
-    if (q->head == q->tail) return 0;
-    *ev = q->q[q->head];
-    q->head = (q->head + 1) % WEN_EVENT_QUEUE_CAP;
-    return 1;
+    wen_uring_conn *conn = (wen_uring_conn *)user;
+    wen_uring *ring = conn->ring;
+
+    // Copy across every reaped buffer that fits, so a short read really
+    // means nothing else is waiting.
+    unsigned long total = 0;
+    while (conn->rx_head != WEN__URING_NONE && total < len) {
+        unsigned id = conn->rx_head;
+        unsigned long n = ring->buf_len[id] - conn->rx_off;
+        if (n > len - total) n = len - total;
+        memcpy((unsigned char *)buf + total, ring->slab + id * ring->buffer_size + conn->rx_off, n);
+        conn->rx_off += n;
+        total += n;
+
+        // Hand a buffer back to the kernel as soon as it is read.
+        if (conn->rx_off == ring->buf_len[id]) {
+            conn->rx_head = ring->buf_next[id];
+            if (conn->rx_head == WEN__URING_NONE) conn->rx_tail = WEN__URING_NONE;
+            conn->rx_off = 0;
+            wen__uring_recycle(ring, id);
+        }
+    }
+    if (total) return (long)total;
+
+    if (conn->rx_done) return conn->rx_result;
+
+    // With the submission queue full, the receive is rearmed on the next poll.
+    if (!conn->rx_armed && !wen__uring_recv(conn) && conn->link && conn->link->loop)
+        wen__loop_queue(conn->link->loop, conn->link);
+    return WEN_IO_WOULD_BLOCK;
 }
 
-//////////////////////////////////////////////////////////////////////////////
+WENDEF long wen__uring_write(void *user, const void *buf, unsigned long len)
+{
+    wen_uring_conn *conn = (wen_uring_conn *)user;
+    wen_uring *ring = conn->ring;
+
+    if (conn->tx_error) return -1;
+    if (conn->tx_busy) return WEN_IO_WOULD_BLOCK;
+
+    // The bytes are the ring's from here on, like those handed to a socket buffer.
+    unsigned long n = len < ring->buffer_size ? len : ring->buffer_size;
+    memcpy(ring->slab + conn->tx_buf * ring->buffer_size, buf, n);
+    conn->tx_off = 0;
+    conn->tx_len = n;
+    if (!wen__uring_send(conn)) return -1;
+    return (long)n;
+}
 
-WENDEF wen_result wen_arena_init(wen_arena *arena, unsigned long size)
+WENDEF void *wen__uring_sqe(wen_uring *ring)
 {
-    if (!arena || size == 0) return WEN_ERR_STATE;
+#ifdef WEN__URING
+    unsigned tail = *ring->sq_tail;
+    if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) > ring->sq_mask) {
+        wen__uring_enter(ring, 0, 0);
+        if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) > ring->sq_mask) return NULL;
+    }
 
-#ifndef WEN_NO_MALLOC
-    arena->base = (unsigned char *)malloc(size);
-    if (!arena->base) return WEN_ERR_IO;
-    arena->owns_memory = true;
+    // Nothing reads the queue before the next io_uring_enter(), so the entry
+    // can be published before the caller fills it in.
+    unsigned i = tail & ring->sq_mask;
+    struct io_uring_sqe *sqe = (struct io_uring_sqe *)ring->sqes + i;
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[i] = i;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->sq_pending++;
+    return sqe;
+#else
+    WEN_UNUSED(ring);
+    return NULL;
 #endif
-    arena->capacity = size;
-    arena->used = 0;
+}
 
-    return WEN_OK;
+WENDEF long wen__uring_enter(wen_uring *ring, unsigned wait, int timeout_ms)
+{
+#ifdef WEN__URING
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+
+    unsigned flags = 0;
+    if (wait) {
+        flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        if (timeout_ms >= 0) {
+            ts.tv_sec = timeout_ms / 1000;
+            ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+            arg.ts = (unsigned long)&ts;
+        }
+    }
+
+    long r = syscall(__NR_io_uring_enter, ring->fd, ring->sq_pending, wait, flags,
+                     wait ? &arg : NULL, wait ? sizeof(arg) : 0);
+    if (r > 0) ring->sq_pending -= (unsigned)r < ring->sq_pending ? (unsigned)r : ring->sq_pending;
+
+    // Running out of time is not an error.
+    if (r < 0 && (errno == ETIME || errno == EINTR)) return 0;
+    return r;
+#else
+    WEN_UNUSED(ring);
+    WEN_UNUSED(wait);
+    WEN_UNUSED(timeout_ms);
+    return -1;
+#endif
 }
 
-WENDEF void wen_arena_bind(wen_arena *arena, void *mem, unsigned long size)
+WENDEF unsigned wen__uring_reap(wen_uring *ring)
 {
-    arena->base = (unsigned char *)mem;
-    arena->capacity = size;
-    arena->used = 0;
+#ifdef WEN__URING
+    unsigned head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; head++) {
+        const struct io_uring_cqe *cqe = (const struct io_uring_cqe *)ring->cqes + (head & ring->cq_mask);
+        wen__uring_complete(ring, cqe->user_data, cqe->res, cqe->flags);
+    }
+    unsigned n = head - *ring->cq_head;
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    return n;
+#else
+    WEN_UNUSED(ring);
+    return 0;
+#endif
 }
 
-WENDEF void wen_arena_reset(wen_arena *a, wen_arena_snapshot mark)
+WENDEF void wen__uring_complete(wen_uring *ring, unsigned long long data, int res, unsigned flags)
 {
-    WEN_ASSERT(mark <= a->used && "wen_arena_reset: invalid snapshot");
-    if (mark > a->used) {
-        WEN_UNREACHABLE("wen_arena_reset");
+#ifdef WEN__URING
+    unsigned tag = (unsigned)(data & 3);
+    void *ptr = (void *)(unsigned long)(data & ~3ULL);
+    if (!ptr) return;
+
+    if (tag == WEN__URING_LOOP) {
+        wen_loop *loop = (wen_loop *)ptr;
+        loop->uring_polling = false;
+        if (res > 0) loop->uring_epoll = true;
         return;
     }
 
-    a->used = mark;
+    wen_uring_conn *conn = (wen_uring_conn *)ptr;
+    if (tag == WEN__URING_RECV) {
+        if (!(flags & IORING_CQE_F_MORE)) {
+            conn->rx_armed = false;
+            conn->inflight--;
+        }
+
+        if (res > 0 && (flags & IORING_CQE_F_BUFFER)) {
+            unsigned id = flags >> IORING_CQE_BUFFER_SHIFT;
+            ring->buf_len[id] = (unsigned)res;
+            ring->buf_next[id] = WEN__URING_NONE;
+            if (conn->closing) {
+                wen__uring_recycle(ring, id);
+            } else {
+                if (conn->rx_tail != WEN__URING_NONE)
+                    ring->buf_next[conn->rx_tail] = id;
+                else
+                    conn->rx_head = id;
+                conn->rx_tail = id;
+            }
+        } else if (res == 0 || (res < 0 && res != -ENOBUFS && res != -ECANCELED)) {
+            // Out of buffers just ends the multishot; the next read rearms it.
+            conn->rx_done = true;
+            conn->rx_result = res == 0 ? 0 : -1;
+        }
+    } else {
+        conn->inflight--;
+        conn->tx_busy = false;
+        if (res < 0) {
+            if (res != -ECANCELED) conn->tx_error = true;
+        } else {
+            // A short send goes on from where it stopped.
+            conn->tx_off += (unsigned long)res;
+            if (conn->tx_off < conn->tx_len && !conn->closing && !wen__uring_send(conn))
+                conn->tx_error = true;
+        }
+    }
+
+    wen_link *link = conn->link;
+    if (conn->closing || !link) return;
+
+    if (tag == WEN__URING_RECV)
+        link->rx_drained = false;
+    else if (!conn->tx_busy)
+        link->tx_blocked = false;
+    if (link->loop) wen__loop_queue(link->loop, link);
+#else
+    WEN_UNUSED(ring);
+    WEN_UNUSED(data);
+    WEN_UNUSED(res);
+    WEN_UNUSED(flags);
+#endif
 }
 
-WENDEF void *wen_arena_alloc(wen_arena *a, unsigned long size)
+WENDEF bool wen__uring_recv(wen_uring_conn *conn)
 {
-    if (!a || !a->base || size == 0) return NULL;
- 
-    unsigned long aligned_used = WEN_ALIGN_UP(a->used, WEN_ARENA_ALIGN);
-    unsigned long aligned_size = WEN_ALIGN_UP(size, WEN_ARENA_ALIGN);
+#ifdef WEN__URING
+    struct io_uring_sqe *sqe = (struct io_uring_sqe *)wen__uring_sqe(conn->ring);
+    if (!sqe) return false;
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->user_data = (unsigned long)conn | WEN__URING_RECV;
+
+    conn->rx_armed = true;
+    conn->inflight++;
+    return true;
+#else
+    WEN_UNUSED(conn);
+    return false;
+#endif
+}
 
-    if (aligned_used > a->capacity || aligned_size > a->capacity - aligned_used)
-        return NULL;
+WENDEF bool wen__uring_send(wen_uring_conn *conn)
+{
+#ifdef WEN__URING
+    wen_uring *ring = conn->ring;
+    struct io_uring_sqe *sqe = (struct io_uring_sqe *)wen__uring_sqe(ring);
+    if (!sqe) return false;
+
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = conn->fd;
+    sqe->addr = (unsigned long)(ring->slab + conn->tx_buf * ring->buffer_size + conn->tx_off);
+    sqe->len = (unsigned)(conn->tx_len - conn->tx_off);
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = (unsigned long)conn | WEN__URING_SEND;
+
+    conn->tx_busy = true;
+    conn->inflight++;
+    return true;
+#else
+    WEN_UNUSED(conn);
+    return false;
+#endif
+}
+
+WENDEF bool wen__uring_cancel(wen_uring *ring, unsigned long long data)
+{
+#ifdef WEN__URING
+    struct io_uring_sqe *sqe = (struct io_uring_sqe *)wen__uring_sqe(ring);
+    if (!sqe) return false;
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = data;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = 0;
+    return true;
+#else
+    WEN_UNUSED(ring);
+    WEN_UNUSED(data);
+    return false;
+#endif
+}
 
-    unsigned long new_used = aligned_used + aligned_size;
-    if (new_used > a->capacity) return NULL;
+WENDEF void wen__uring_recycle(wen_uring *ring, unsigned id)
+{
+#ifdef WEN__URING
+    struct io_uring_buf_ring *br = (struct io_uring_buf_ring *)ring->buf_ring;
+    struct io_uring_buf *b = &br->bufs[ring->buf_tail & (ring->buffers - 1)];
+    b->addr = (unsigned long)(ring->slab + id * ring->buffer_size);
+    b->len = (unsigned)ring->buffer_size;
+    b->bid = (unsigned short)id;
+    ring->buf_tail++;
+    __atomic_store_n(&br->tail, ring->buf_tail, __ATOMIC_RELEASE);
+#else
+    WEN_UNUSED(ring);
+    WEN_UNUSED(id);
+#endif
+}
 
-    a->used = new_used;
-    return a->base + aligned_used;
+WENDEF void wen__loop_queue(wen_loop *loop, wen_link *link)
+{
+    if (link->loop_queued) return;
+
+    link->loop_queued = true;
+    link->loop_next = NULL;
+    link->loop_prev = loop->ready_tail;
+    if (loop->ready_tail)
+        loop->ready_tail->loop_next = link;
+    else
+        loop->ready_head = link;
+    loop->ready_tail = link;
+    loop->ready_count++;
 }
 
-WENDEF void *wen_arena_calloc(wen_arena *a, unsigned long count, unsigned long size)
+WENDEF void wen__loop_unqueue(wen_loop *loop, wen_link *link)
 {
-    if (count == 0 || size == 0) return NULL;
-    if (count > (~0UL / size)) return NULL;
+    if (!link->loop_queued) return;
+
+    if (link->loop_prev)
+        link->loop_prev->loop_next = link->loop_next;
+    else
+        loop->ready_head = link->loop_next;
+    if (link->loop_next)
+        link->loop_next->loop_prev = link->loop_prev;
+    else
+        loop->ready_tail = link->loop_prev;
+
+    link->loop_prev = NULL;
+    link->loop_next = NULL;
+    link->loop_queued = false;
+    loop->ready_count--;
+}
 
-    unsigned long total = count * size;
-    void *ptr = wen_arena_alloc(a, total);
-    if (!ptr) return NULL;
+WENDEF void wen__loop_touch(wen_loop *loop, wen_link *link)
+{
+    if (loop->current == link || link->loop_queued) return;
 
-    memset(ptr, 0, total);
-    return ptr;
+    // Work that the application created outside of wen_loop_run(): events to
+    // deliver, output to flush or input waiting for a released slice slot.
+    bool events = link->evq.head != link->evq.tail;
+    bool tx = (link->tx_len || link->tx_ref_count) && !link->tx_blocked;
+    if (events || tx || link->rx_len) wen__loop_queue(loop, link);
 }
 
 #endif // WEN_IMPLEMENTATION